@@ -0,0 +1,92 @@
+#include "internal.hpp"
+
+#include <cstring>
+
+// raylib уже содержит реализацию stb_rect_pack для упаковки шрифтов, поэтому
+// здесь она собирается со static, чтобы имена функций не пересекались.
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <external/stb_rect_pack.h>
+
+// Расстояние в пикселях между соседними картинками в атласе. Без него при
+// отрисовке на дробных координатах в картинку могут попадать пиксели соседей.
+static const int ATLAS_PADDING = 1;
+
+// Копирует картинку src формата RGBA8 в атлас dst так, чтобы её левый верхний
+// угол оказался в точке (x, y).
+static void CopyToAtlas(Image &dst, const Image &src, int x, int y) {
+    auto *dst_pixels = static_cast<unsigned char *>(dst.data);
+    auto *src_pixels = static_cast<const unsigned char *>(src.data);
+    for (int row = 0; row < src.height; ++row) {
+        std::memcpy(
+            dst_pixels + (size_t(y + row) * dst.width + x) * 4,
+            src_pixels + size_t(row) * src.width * 4,
+            size_t(src.width) * 4
+        );
+    }
+}
+
+void TextureRegistry::BuildAtlas() {
+    if (loader && loader->Pending() > 0) {
+        atlas_requested = true;
+        return;
+    }
+    atlas_built = true;
+
+    std::vector<stbrp_rect> rects;
+    for (size_t id = 0; id < pending_images.size(); ++id) {
+        const Image &image = pending_images[id];
+        if (image.data == nullptr) {
+            continue;
+        }
+        stbrp_rect rect = {};
+        rect.id = int(id);
+        rect.w = image.width + ATLAS_PADDING;
+        rect.h = image.height + ATLAS_PADDING;
+        rects.push_back(rect);
+    }
+
+    std::vector<stbrp_node> nodes(ATLAS_SIZE);
+    while (!rects.empty()) {
+        stbrp_context packer;
+        stbrp_init_target(
+            &packer, ATLAS_SIZE, ATLAS_SIZE, nodes.data(), int(nodes.size())
+        );
+        stbrp_pack_rects(&packer, rects.data(), int(rects.size()));
+
+        Image page = GenImageColor(ATLAS_SIZE, ATLAS_SIZE, BLANK);
+        std::vector<stbrp_rect> packed;
+        std::vector<stbrp_rect> rest;
+        for (const stbrp_rect &rect : rects) {
+            if (!rect.was_packed) {
+                rest.push_back(rect);
+                continue;
+            }
+            CopyToAtlas(page, pending_images[rect.id], rect.x, rect.y);
+            packed.push_back(rect);
+        }
+        Texture atlas = LoadTextureFromImage(page);
+        UnloadImage(page);
+        atlases.push_back(atlas);
+
+        for (const stbrp_rect &rect : packed) {
+            TextureEntry &entry = entries[rect.id];
+            UnloadTexture(entry.texture);
+            entry.texture = atlas;
+            entry.source = Rectangle{
+                float(rect.x),
+                float(rect.y),
+                float(rect.w - ATLAS_PADDING),
+                float(rect.h - ATLAS_PADDING),
+            };
+        }
+        rects = std::move(rest);
+    }
+
+    for (Image &image : pending_images) {
+        if (image.data != nullptr) {
+            UnloadImage(image);
+        }
+    }
+    pending_images.clear();
+}
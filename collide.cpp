@@ -0,0 +1,169 @@
+#include "collide.hpp"
+
+#include <cmath>
+
+// AVX2 включается опцией MIT_GAME_AVX2 в CMakeLists.txt. SSE2 есть на любом
+// процессоре x86-64, поэтому на нём эта версия используется по умолчанию.
+// На остальных процессорах (например, Apple M1) работает обычный цикл.
+#if defined(__AVX2__)
+#define COLLIDE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)                                    \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLLIDE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Проверка одного прямоугольника набора. Формулы повторяют CheckCollision,
+// чтобы результаты совпадали до последнего бита.
+static inline void CollideOne(
+    float cx,
+    float cy,
+    float hw,
+    float hh,
+    const AabbBatch &batch,
+    size_t i,
+    std::vector<AabbHit> &hits
+) {
+    float dx = batch.x[i] - cx;
+    float dy = batch.y[i] - cy;
+    float qx = std::abs(dx) - (hw + batch.half_w[i]);
+    float qy = std::abs(dy) - (hh + batch.half_h[i]);
+    if (qx < 0 && qy < 0) {
+        hits.push_back(AabbHit{
+            uint32_t(i),
+            {dx < 0 ? qx : -qx, dy < 0 ? qy : -qy},
+        });
+    }
+}
+
+void CollideBatchScalar(
+    Vector2 center,
+    Vector2 size,
+    const AabbBatch &batch,
+    size_t first,
+    std::vector<AabbHit> &hits
+) {
+    hits.clear();
+    float hw = size.x * 0.5f;
+    float hh = size.y * 0.5f;
+    for (size_t i = first; i < batch.size(); ++i) {
+        CollideOne(center.x, center.y, hw, hh, batch, i, hits);
+    }
+}
+
+void CollideBatch(
+    Vector2 center,
+    Vector2 size,
+    const AabbBatch &batch,
+    size_t first,
+    std::vector<AabbHit> &hits
+) {
+    hits.clear();
+    float hw = size.x * 0.5f;
+    float hh = size.y * 0.5f;
+    size_t i = first;
+
+#if defined(COLLIDE_AVX2)
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 cx = _mm256_set1_ps(center.x);
+    const __m256 cy = _mm256_set1_ps(center.y);
+    const __m256 vhw = _mm256_set1_ps(hw);
+    const __m256 vhh = _mm256_set1_ps(hh);
+    for (; i + 8 <= batch.size(); i += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&batch.x[i]), cx);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&batch.y[i]), cy);
+        __m256 qx = _mm256_sub_ps(
+            _mm256_andnot_ps(sign, dx),
+            _mm256_add_ps(vhw, _mm256_loadu_ps(&batch.half_w[i]))
+        );
+        __m256 qy = _mm256_sub_ps(
+            _mm256_andnot_ps(sign, dy),
+            _mm256_add_ps(vhh, _mm256_loadu_ps(&batch.half_h[i]))
+        );
+        __m256 hit = _mm256_and_ps(
+            _mm256_cmp_ps(qx, zero, _CMP_LT_OQ),
+            _mm256_cmp_ps(qy, zero, _CMP_LT_OQ)
+        );
+        int mask = _mm256_movemask_ps(hit);
+        if (mask == 0) {
+            continue;
+        }
+        __m256 ox = _mm256_blendv_ps(
+            _mm256_xor_ps(qx, sign), qx, _mm256_cmp_ps(dx, zero, _CMP_LT_OQ)
+        );
+        __m256 oy = _mm256_blendv_ps(
+            _mm256_xor_ps(qy, sign), qy, _mm256_cmp_ps(dy, zero, _CMP_LT_OQ)
+        );
+        alignas(32) float oxs[8], oys[8];
+        _mm256_store_ps(oxs, ox);
+        _mm256_store_ps(oys, oy);
+        for (int lane = 0; lane < 8; ++lane) {
+            if (mask & (1 << lane)) {
+                hits.push_back(
+                    AabbHit{uint32_t(i + lane), {oxs[lane], oys[lane]}}
+                );
+            }
+        }
+    }
+#elif defined(COLLIDE_SSE2)
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 vhw = _mm_set1_ps(hw);
+    const __m128 vhh = _mm_set1_ps(hh);
+    for (; i + 4 <= batch.size(); i += 4) {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(&batch.x[i]), cx);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(&batch.y[i]), cy);
+        __m128 qx = _mm_sub_ps(
+            _mm_andnot_ps(sign, dx),
+            _mm_add_ps(vhw, _mm_loadu_ps(&batch.half_w[i]))
+        );
+        __m128 qy = _mm_sub_ps(
+            _mm_andnot_ps(sign, dy),
+            _mm_add_ps(vhh, _mm_loadu_ps(&batch.half_h[i]))
+        );
+        __m128 hit
+            = _mm_and_ps(_mm_cmplt_ps(qx, zero), _mm_cmplt_ps(qy, zero));
+        int mask = _mm_movemask_ps(hit);
+        if (mask == 0) {
+            continue;
+        }
+        // В SSE2 нет blendv, поэтому выбор между q и -q делается масками.
+        __m128 negx = _mm_cmplt_ps(dx, zero);
+        __m128 negy = _mm_cmplt_ps(dy, zero);
+        __m128 ox = _mm_or_ps(
+            _mm_and_ps(negx, qx), _mm_andnot_ps(negx, _mm_xor_ps(qx, sign))
+        );
+        __m128 oy = _mm_or_ps(
+            _mm_and_ps(negy, qy), _mm_andnot_ps(negy, _mm_xor_ps(qy, sign))
+        );
+        alignas(16) float oxs[4], oys[4];
+        _mm_store_ps(oxs, ox);
+        _mm_store_ps(oys, oy);
+        for (int lane = 0; lane < 4; ++lane) {
+            if (mask & (1 << lane)) {
+                hits.push_back(
+                    AabbHit{uint32_t(i + lane), {oxs[lane], oys[lane]}}
+                );
+            }
+        }
+    }
+#endif
+
+    for (; i < batch.size(); ++i) {
+        CollideOne(center.x, center.y, hw, hh, batch, i, hits);
+    }
+}
+
+const char *CollideBatchIsa() {
+#if defined(COLLIDE_AVX2)
+    return "AVX2";
+#elif defined(COLLIDE_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <raylib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Структура AabbBatch хранит набор прямоугольников, с которыми нужно
+// проверить столкновение одного объекта. Координаты центров и половины
+// размеров лежат в отдельных массивах, поэтому CollideBatch может загружать
+// их в SIMD-регистры сразу по 4 (SSE2) или 8 (AVX2) штук.
+struct AabbBatch {
+    std::vector<float> x, y;
+    std::vector<float> half_w, half_h;
+
+    void Clear() {
+        x.clear();
+        y.clear();
+        half_w.clear();
+        half_h.clear();
+    }
+
+    // Добавляет прямоугольник с центром center и размерами size.
+    void Add(Vector2 center, Vector2 size) {
+        x.push_back(center.x);
+        y.push_back(center.y);
+        half_w.push_back(size.x * 0.5f);
+        half_h.push_back(size.y * 0.5f);
+    }
+
+    size_t size() const {
+        return x.size();
+    }
+};
+
+// Пересечение с index-м прямоугольником набора. overlap имеет тот же смысл,
+// что и в Collision.
+struct AabbHit {
+    uint32_t index;
+    Vector2 overlap;
+};
+
+// Проверяет, пересекается ли прямоугольник с центром center и размерами size
+// с прямоугольниками batch с номерами first, first + 1, ... Все найденные
+// пересечения записываются в hits в порядке возрастания номеров. Результат
+// совпадает с тем, что вернула бы CheckCollision для каждой пары по
+// отдельности.
+void CollideBatch(
+    Vector2 center,
+    Vector2 size,
+    const AabbBatch &batch,
+    size_t first,
+    std::vector<AabbHit> &hits
+);
+
+// То же самое, но без SIMD. Нужна, чтобы сверять с ней результат и скорость
+// CollideBatch.
+void CollideBatchScalar(
+    Vector2 center,
+    Vector2 size,
+    const AabbBatch &batch,
+    size_t first,
+    std::vector<AabbHit> &hits
+);
+
+// Возвращает название набора инструкций, который использует CollideBatch:
+// "AVX2", "SSE2" или "scalar".
+const char *CollideBatchIsa();
@@ -0,0 +1,68 @@
+#include "grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void SpatialGrid::Reset(float new_cell_size) {
+    cell_size = new_cell_size > 0 ? new_cell_size : 1.0f;
+    // Объекты уходят из клеток, в которые больше не вернутся (например, на
+    // длинном уровне). Если пустых клеток стало намного больше занятых,
+    // таблица собирается заново, иначе она росла бы без ограничений, а
+    // очистка стоила бы O(всех когда-либо занятых клеток).
+    if (cells.size() > 2 * used_cells + 64) {
+        cells.clear();
+    } else {
+        for (auto &cell : cells) {
+            cell.second.clear();
+        }
+    }
+    used_cells = 0;
+}
+
+void SpatialGrid::Insert(size_t item, Vector2 center, Vector2 size) {
+    int x0 = CellCoord(center.x - size.x * 0.5f);
+    int x1 = CellCoord(center.x + size.x * 0.5f);
+    int y0 = CellCoord(center.y - size.y * 0.5f);
+    int y1 = CellCoord(center.y + size.y * 0.5f);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            std::vector<size_t> &cell = cells[CellKey(x, y)];
+            if (cell.empty()) {
+                used_cells += 1;
+            }
+            cell.push_back(item);
+        }
+    }
+}
+
+void SpatialGrid::Query(
+    Vector2 center,
+    Vector2 size,
+    std::vector<size_t> &out
+) const {
+    out.clear();
+    int x0 = CellCoord(center.x - size.x * 0.5f);
+    int x1 = CellCoord(center.x + size.x * 0.5f);
+    int y0 = CellCoord(center.y - size.y * 0.5f);
+    int y1 = CellCoord(center.y + size.y * 0.5f);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            auto it = cells.find(CellKey(x, y));
+            if (it != cells.end()) {
+                out.insert(out.end(), it->second.begin(), it->second.end());
+            }
+        }
+    }
+    // Объект, который накрывает несколько клеток, мог попасть в out
+    // несколько раз.
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+int SpatialGrid::CellCoord(float x) const {
+    return int(std::floor(x / cell_size));
+}
+
+uint64_t SpatialGrid::CellKey(int x, int y) {
+    return (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(y));
+}
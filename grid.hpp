@@ -0,0 +1,49 @@
+#pragma once
+
+#include <raylib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Структура SpatialGrid - равномерная сетка, которая используется для
+// быстрого поиска объектов, находящихся рядом с заданным прямоугольником.
+// Вместо того, чтобы перебирать все пары объектов сцены, каждый объект
+// кладётся в те клетки сетки, которые он накрывает, а при поиске
+// просматриваются только клетки вокруг нужного прямоугольника.
+//
+// В клетках хранятся не сами объекты, а их индексы в сцене, поэтому сетку
+// нужно перестраивать каждый раз, когда объекты двигаются или сцена меняется.
+// Векторы в клетках при очистке не освобождаются, так что перестройка сетки
+// каждый кадр не приводит к лишним выделениям памяти. Если всех клеток
+// стало больше, чем удвоенное число занятых с прошлого Reset плюс 64, Reset
+// выбрасывает их все, поэтому размер сетки зависит от числа объектов, а не
+// от длины уровня.
+struct SpatialGrid {
+    float cell_size;
+
+    SpatialGrid() : cell_size(1.0f) {}
+
+    // Очищает сетку и задаёт новый размер клетки в метрах. Обычно размер
+    // клетки выбирают равным наибольшему размеру коллайдера, тогда каждый
+    // объект попадает не более чем в четыре клетки.
+    void Reset(float new_cell_size);
+
+    // Добавляет элемент с индексом item, занимающий прямоугольник с центром
+    // center и размерами size.
+    void Insert(size_t item, Vector2 center, Vector2 size);
+
+    // Записывает в out индексы всех элементов, клетки которых пересекаются с
+    // прямоугольником с центром center и размерами size. Индексы в out
+    // отсортированы по возрастанию и не повторяются.
+    void Query(Vector2 center, Vector2 size, std::vector<size_t> &out) const;
+
+private:
+    std::unordered_map<uint64_t, std::vector<size_t>> cells;
+    // Число непустых клеток с последнего вызова Reset.
+    size_t used_cells = 0;
+
+    int CellCoord(float x) const;
+    static uint64_t CellKey(int x, int y);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// 64-битное хеширование в духе wyhash. Основа - операция Mum: два числа
+// перемножаются в 128-битное произведение, и его половины складываются через
+// xor. Одно такое умножение перемешивает все 64 бита входа, поэтому данные
+// обрабатываются по 8 байт за шаг, а не по одному, и получающиеся хеши
+// распределены гораздо равномернее, чем у Adler32.
+
+namespace hash_detail {
+
+const uint64_t P0 = 0xa0761d6478bd642full;
+const uint64_t P1 = 0xe7037ed1a0b428dbull;
+const uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+
+inline uint64_t Mum(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = __uint128_t(a) * b;
+    return uint64_t(r) ^ uint64_t(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    uint64_t a_lo = uint32_t(a), a_hi = a >> 32;
+    uint64_t b_lo = uint32_t(b), b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + uint32_t(hi_lo) + lo_hi;
+    uint64_t hi = hi_hi + (hi_lo >> 32) + (cross >> 32);
+    uint64_t lo = (cross << 32) | uint32_t(lo_lo);
+    return lo ^ hi;
+#endif
+}
+
+} // namespace hash_detail
+
+// Хеширует len байт по адресу data.
+inline uint64_t HashBytes(const void *data, size_t len, uint64_t seed = 0) {
+    using namespace hash_detail;
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    uint64_t h = seed ^ Mum(seed ^ P0, len ^ P1);
+    size_t rest = len;
+    for (; rest >= 8; rest -= 8, p += 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = Mum(word ^ P1, h ^ P0);
+    }
+    if (rest > 0) {
+        uint64_t word = 0;
+        std::memcpy(&word, p, rest);
+        h = Mum(word ^ P2, h ^ P0);
+    }
+    return Mum(h ^ P1, len ^ P2);
+}
+
+// Объединяет хеш h с ещё одним 64-битным значением value.
+inline uint64_t HashCombine(uint64_t h, uint64_t value) {
+    using namespace hash_detail;
+    return Mum(h ^ P0, value ^ P2);
+}
@@ -0,0 +1,366 @@
+// Headless-режим игры: уровень загружается без окна и без текстур, после чего
+// симуляция прогоняется фиксированное число шагов с постоянным dt и заранее
+// заданным вводом игрока. В конце печатается скорость симуляции, поэтому
+// программа годится для замеров производительности на машинах без экрана.
+//
+// Использование:
+//   mit-game-headless [опции] [путь к уровню]
+//
+// Опции:
+//   --ticks N      число шагов симуляции (по умолчанию 10000)
+//   --hz N         частота шагов, dt = 1 / N (по умолчанию 60)
+//   --generate W   вместо файла сгенерировать уровень шириной W клеток
+//   --restarts N   замерить N перезапусков уровня (по умолчанию 1000)
+//   --threads N    обновлять объекты в N потоках (по умолчанию 1)
+//   --crowd K      в сгенерированном уровне ставить толпы по K врагов
+//                  вместо одиночных врагов (K от 1 до 7)
+//   --compile      перед загрузкой скомпилировать уровень в бинарный формат
+//                  (см. level.hpp) и загружать уже его
+//   --no-streaming создать все объекты уровня сразу, а не подгружать их по
+//                  мере движения камеры
+//   --check-islands
+//                  прогнать симуляцию дважды: в одном потоке без островов и
+//                  в --threads потоках с островами, и сравнить результаты.
+//                  Острова используются принудительно (см.
+//                  collision_islands_forced), а потоков берётся не меньше 2
+//   --bench-collide N
+//                  вместо симуляции сравнить скорость CollideBatch и
+//                  обычного цикла на наборе из N прямоугольников
+//
+// Запускать нужно из корня репозитория, чтобы находились файлы Assets.
+
+#include "internal.hpp"
+#include "user.hpp"
+#include "collide.hpp"
+
+#include <raylib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+static double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Номер текущего шага. Нужен сценарию ввода, который не может хранить
+// состояние в себе, так как Input хранит обычные указатели на функции.
+static int script_tick = 0;
+
+// Сценарий ввода: игрок бежит вправо, иногда разворачивается, регулярно
+// прыгает и стреляет. Сценарий зависит только от номера шага, поэтому
+// каждый запуск даёт одинаковый результат.
+static bool ScriptKeyDown(int key) {
+    bool going_left = script_tick % 600 >= 480;
+    switch (key) {
+    case KEY_A:
+        return going_left;
+    case KEY_D:
+        return !going_left;
+    case KEY_SPACE:
+        return script_tick % 90 < 5;
+    case KEY_J:
+        return script_tick % 30 == 0;
+    default:
+        return false;
+    }
+}
+
+// Записывает во временный файл уровень шириной width клеток: пол, стены по
+// краям, платформы и врагов через равные промежутки. Если crowd > 1, то вместо
+// одиночного врага на полу стоит толпа из crowd врагов вплотную друг к другу.
+// Возвращает путь к файлу.
+static std::string GenerateLevel(int width, int crowd) {
+    const int height = 10;
+    std::vector<std::string> rows(height, std::string(width, ' '));
+    rows[0] = std::string(width, '=');
+    for (int row = 1; row < height; ++row) {
+        rows[row][0] = '*';
+        rows[row][width - 1] = '*';
+    }
+    for (int row = height - 3; row < height; ++row) {
+        rows[row] = std::string(width, '+');
+    }
+    for (int col = 8; col + 4 < width; col += 16) {
+        rows[4][col] = '*';
+        rows[4][col + 1] = '*';
+        rows[4][col + 2] = '*';
+        rows[3][col + 1] = '1';
+        for (int k = 0; k < crowd && col + 8 + k < width - 1; ++k) {
+            rows[6][col + 8 + k] = '1';
+        }
+    }
+    rows[4][4] = 'p';
+    rows[6][width - 3] = 'f';
+
+    std::filesystem::path path = std::filesystem::temp_directory_path()
+                                 / "mit-game-generated.lvl";
+    std::ofstream file(path);
+    for (const std::string &row : rows) {
+        file << row << '\n';
+    }
+    return path.string();
+}
+
+// Микробенчмарк CollideBatch: один прямоугольник размером с игрока
+// проверяется против count случайных прямоугольников размером со стену,
+// лежащих вокруг него плотно, как стены в тесном месте уровня. Результаты
+// SIMD-версии сверяются с обычным циклом.
+static int BenchCollide(int count) {
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> coord(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> extent(0.5f, 3.0f);
+    AabbBatch batch;
+    for (int i = 0; i < count; ++i) {
+        batch.Add({coord(rng), coord(rng)}, {extent(rng), extent(rng)});
+    }
+
+    const Vector2 size = {1.6f, 1.6f};
+    const int queries = std::max(1, 20'000'000 / count);
+    std::vector<Vector2> centers;
+    for (int i = 0; i < 256; ++i) {
+        centers.push_back({coord(rng), coord(rng)});
+    }
+
+    std::vector<AabbHit> simd_hits, scalar_hits;
+    for (Vector2 center : centers) {
+        CollideBatch(center, size, batch, 0, simd_hits);
+        CollideBatchScalar(center, size, batch, 0, scalar_hits);
+        bool same = simd_hits.size() == scalar_hits.size();
+        for (size_t i = 0; same && i < simd_hits.size(); ++i) {
+            same = simd_hits[i].index == scalar_hits[i].index
+                   && simd_hits[i].overlap.x == scalar_hits[i].overlap.x
+                   && simd_hits[i].overlap.y == scalar_hits[i].overlap.y;
+        }
+        if (!same) {
+            std::fprintf(stderr, "CollideBatch не совпадает с циклом\n");
+            return 1;
+        }
+    }
+
+    size_t total_hits = 0;
+    auto start = Clock::now();
+    for (int q = 0; q < queries; ++q) {
+        CollideBatchScalar(centers[q % 256], size, batch, 0, scalar_hits);
+        total_hits += scalar_hits.size();
+    }
+    double scalar_time = SecondsSince(start);
+
+    start = Clock::now();
+    for (int q = 0; q < queries; ++q) {
+        CollideBatch(centers[q % 256], size, batch, 0, simd_hits);
+        total_hits += simd_hits.size();
+    }
+    double simd_time = SecondsSince(start);
+
+    double tests = double(queries) * count;
+    std::printf("boxes: %d, queries: %d\n", count, queries);
+    std::printf("hits/query: %.2f\n", total_hits / 2.0 / queries);
+    std::printf("scalar: %.3f ns/box\n", scalar_time * 1e9 / tests);
+    std::printf(
+        "%s: %.3f ns/box\n", CollideBatchIsa(), simd_time * 1e9 / tests
+    );
+    std::printf("speedup: %.2fx\n", scalar_time / simd_time);
+    return 0;
+}
+
+struct RunResult {
+    double elapsed;
+    size_t objects;
+    Vector2 player;
+    // Хэш точных значений всех позиций, чтобы сравнивать запуски побитово.
+    uint64_t checksum;
+};
+
+// Сбрасывает текущую сцену к уровню level и делает ticks шагов симуляции.
+static RunResult Simulate(Context &ctx, const Scene &level, int ticks) {
+    ctx.current_scene.ResetFrom(level);
+    ctx.camera_pos = {0, 0};
+    ctx.prev_camera_pos = {0, 0};
+    ctx.time = 0;
+
+    const float dt = 1.0f / float(ctx.physics_hz);
+    auto start = Clock::now();
+    for (script_tick = 0; script_tick < ticks; ++script_tick) {
+        ctx.time += uint64_t(dt * 1000);
+        StepGame(ctx, dt);
+    }
+
+    RunResult result;
+    result.elapsed = SecondsSince(start);
+    result.objects = ctx.current_scene.size();
+    result.player = find_player(ctx.current_scene)->position;
+    result.checksum = 0;
+    for (Vector2 position : ctx.current_scene.positions) {
+        uint32_t bits[2];
+        std::memcpy(bits, &position, sizeof(bits));
+        result.checksum = result.checksum * 1'000'003 + bits[0];
+        result.checksum = result.checksum * 1'000'003 + bits[1];
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int ticks = 10000;
+    int hz = 60;
+    int generate_width = 0;
+    int restarts = 1000;
+    int bench_collide = 0;
+    int threads = 1;
+    int crowd = 1;
+    bool check_islands = false;
+    bool compile = false;
+    std::string level_path = "Assets/game.lvl";
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--ticks") == 0 && has_value) {
+            ticks = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--hz") == 0 && has_value) {
+            hz = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--generate") == 0 && has_value) {
+            generate_width = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--restarts") == 0 && has_value) {
+            restarts = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--crowd") == 0 && has_value) {
+            crowd = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--no-streaming") == 0) {
+            level_streaming = false;
+        } else if (std::strcmp(argv[i], "--compile") == 0) {
+            compile = true;
+        } else if (std::strcmp(argv[i], "--check-islands") == 0) {
+            check_islands = true;
+        } else if (std::strcmp(argv[i], "--bench-collide") == 0 && has_value) {
+            bench_collide = std::atoi(argv[++i]);
+        } else {
+            level_path = argv[i];
+        }
+    }
+    if (ticks <= 0 || hz <= 0 || restarts < 0 || threads <= 0 || crowd < 1
+        || crowd > 7) {
+        std::fprintf(stderr, "Неверные параметры запуска\n");
+        return 1;
+    }
+    if (bench_collide > 0) {
+        return BenchCollide(bench_collide);
+    }
+    if (generate_width > 0) {
+        level_path = GenerateLevel(std::max(generate_width, 32), crowd);
+    }
+    if (compile) {
+        std::filesystem::path path = std::filesystem::temp_directory_path()
+                                     / "mit-game-compiled.lvlb";
+        std::string error;
+        if (!CompileLevel(level_path, path.string(), error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        level_path = path.string();
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+
+    Context ctx;
+    ctx.camera_pos = {0, 0};
+    ctx.prev_camera_pos = {0, 0};
+    ctx.screen_size = {800, 600};
+    ctx.time = 0;
+    ctx.lives = 3;
+    ctx.score = 0;
+    ctx.state = GameState::IS_ALIVE;
+    ctx.input_blocked = false;
+    ctx.input.key_down = ScriptKeyDown;
+    ctx.physics_hz = hz;
+    ctx.textures.headless = true;
+    ctx.show_debug = false;
+    if (check_islands && threads < 2) {
+        // Без второго потока острова решались бы в одном куске и проверка
+        // ничего бы не проверила.
+        threads = 4;
+    }
+    if (threads > 1) {
+        ctx.jobs = std::make_unique<JobSystem>(threads - 1);
+    }
+
+    auto load_start = Clock::now();
+    ReadScene(ctx, ctx.scenes["game"], level_path);
+    double load_time = SecondsSince(load_start);
+    const Scene &level = ctx.scenes["game"];
+    if (!find_player(ctx.scenes["game"])) {
+        std::fprintf(stderr, "На уровне %s нет игрока\n", level_path.c_str());
+        return 1;
+    }
+
+    // Перезапуск уровня, как после смерти игрока.
+    auto restart_start = Clock::now();
+    for (int i = 0; i < restarts; ++i) {
+        ctx.current_scene.ResetFrom(level);
+    }
+    double restart_time = SecondsSince(restart_start);
+
+    if (check_islands) {
+        // Эталон: один поток, объекты решаются строго по очереди.
+        std::unique_ptr<JobSystem> jobs = std::move(ctx.jobs);
+        collision_islands = false;
+        RunResult serial = Simulate(ctx, level, ticks);
+        ctx.jobs = std::move(jobs);
+        collision_islands = true;
+        collision_islands_forced = true;
+        RunResult islands = Simulate(ctx, level, ticks);
+        collision_islands_forced = false;
+
+        std::printf("objects: %zu\n", level.size());
+        std::printf("serial: %.3f us/tick\n", serial.elapsed * 1e6 / ticks);
+        std::printf(
+            "islands, %d threads: %.3f us/tick\n",
+            threads,
+            islands.elapsed * 1e6 / ticks
+        );
+        if (serial.checksum != islands.checksum) {
+            std::printf(
+                "MISMATCH: %016llx != %016llx\n",
+                (unsigned long long)serial.checksum,
+                (unsigned long long)islands.checksum
+            );
+            return 1;
+        }
+        std::printf(
+            "results match: %016llx\n", (unsigned long long)serial.checksum
+        );
+        return 0;
+    }
+
+    RunResult result = Simulate(ctx, level, ticks);
+    std::printf("level: %s\n", level_path.c_str());
+    std::printf(
+        "tiles: %dx%d, objects: %zu\n",
+        level.tiles->width,
+        level.tiles->height,
+        result.objects
+    );
+    std::printf("load: %.3f ms\n", load_time * 1e3);
+    std::printf("ticks: %d at %d Hz, threads: %d\n", ticks, hz, threads);
+    std::printf("elapsed: %.3f s\n", result.elapsed);
+    std::printf("ticks/second: %.0f\n", ticks / result.elapsed);
+    std::printf("us/tick: %.3f\n", result.elapsed * 1e6 / ticks);
+    if (restarts > 0) {
+        std::printf("us/restart: %.3f\n", restart_time * 1e6 / restarts);
+    }
+    std::printf(
+        "player position: %.4f %.4f\n", result.player.x, result.player.y
+    );
+    std::printf(
+        "state checksum: %016llx\n", (unsigned long long)result.checksum
+    );
+
+    return 0;
+}
@@ -6,6 +6,15 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+
+bool collision_broadphase = true;
+bool collision_islands = true;
+bool collision_islands_forced = false;
+bool level_streaming = true;
+
+thread_local PendingChanges *deferred_changes = nullptr;
 
 Vector2 local_to_screen(Context *ctx, Vector2 point) {
     Vector2 screen_units = ctx->screen_size / PIXEL_PER_UNIT;
@@ -16,15 +25,118 @@ Vector2 local_to_screen(Context *ctx, Vector2 point) {
     };
 }
 
+Vector2 camera_view_size(const Context &ctx) {
+    return ctx.screen_size / PIXEL_PER_UNIT;
+}
+
+bool IsOnScreen(const Context &ctx, Vector2 center, Vector2 size) {
+    Vector2 view = camera_view_size(ctx);
+    return std::fabs(center.x - ctx.camera_pos.x) * 2 <= size.x + view.x
+           && std::fabs(center.y - ctx.camera_pos.y) * 2 <= size.y + view.y;
+}
+
+void StepGame(Context &ctx, float dt) {
+    Scene &scene = ctx.current_scene;
+    scene.prev_positions = scene.positions;
+    ctx.prev_camera_pos = ctx.camera_pos;
+    ObjectRef player = *find_player(scene);
+
+    PlayerControl(ctx, player, dt);
+
+    // Каждая система проходит только по объектам со своим компонентом.
+    // Объекты в этих системах обновляются независимо друг от друга, поэтому
+    // их можно обновлять в нескольких потоках.
+    ParallelForEach(ctx, scene.WithPhysics(), [dt](ObjectRef obj) {
+        ApplyGravity(obj, dt);
+    });
+    ParallelForEach(ctx, scene.WithEnemy(), [&scene, dt](ObjectRef enemy) {
+        EnemyAI(enemy, scene, dt);
+    });
+    ParallelForEach(ctx, scene.WithBullet(), [&ctx, dt](ObjectRef bullet) {
+        UpdateBullet(ctx, bullet, dt);
+    });
+
+    FixCollisions(ctx.current_scene, dt, ctx.jobs.get());
+    MoveCameraTowards(ctx, player, dt);
+    KillEnemies(ctx);
+    StreamLevel(ctx);
+
+    ApplyPendingChanges(ctx);
+}
+
 void Spawn(Context &ctx, Object obj) {
+    if (deferred_changes) {
+        // ApplyOnSpawn вызовется в основном потоке, когда ParallelForEach
+        // будет переносить объект в ctx.to_spawn.
+        deferred_changes->to_spawn.push_back(std::move(obj));
+        return;
+    }
     ApplyOnSpawn(ctx, obj);
     ctx.to_spawn.push_back(std::move(obj));
 }
 
-void Destroy(Context &ctx, Object &obj) {
+void Destroy(Context &ctx, ObjectRef obj) {
+    if (deferred_changes) {
+        deferred_changes->to_destroy.push_back(obj.id);
+        return;
+    }
     ctx.to_destroy.push_back(obj.id);
 }
 
+void ParallelForEach(
+    Context &ctx,
+    SceneView view,
+    const std::function<void(ObjectRef)> &update
+) {
+    if (!ctx.jobs) {
+        for (ObjectRef obj : view) {
+            update(obj);
+        }
+        return;
+    }
+
+    // Отложенные изменения собираются по кускам, а не по потокам: номер
+    // куска не зависит от того, какой поток его выполнил. Буфер свой у
+    // каждого вызова, чтобы вложенный ParallelForEach не затёр его.
+    std::vector<PendingChanges> chunk_changes(
+        JobSystem::ChunkCount(view.size())
+    );
+    auto run_chunk = [&](size_t begin, size_t end, size_t chunk) {
+        PendingChanges *outer = deferred_changes;
+        deferred_changes = &chunk_changes[chunk];
+        for (size_t i = begin; i < end; ++i) {
+            update((*view.scene)[(*view.slots)[i]]);
+        }
+        deferred_changes = outer;
+    };
+    ctx.jobs->ParallelFor(view.size(), run_chunk);
+
+    // Вложенный вызов отдаёт изменения в буфер внешнего, как Spawn и
+    // Destroy.
+    std::vector<GameId> &to_destroy
+        = deferred_changes ? deferred_changes->to_destroy : ctx.to_destroy;
+    for (PendingChanges &changes : chunk_changes) {
+        to_destroy.insert(
+            to_destroy.end(),
+            changes.to_destroy.begin(),
+            changes.to_destroy.end()
+        );
+        for (Object &obj : changes.to_spawn) {
+            Spawn(ctx, std::move(obj));
+        }
+    }
+}
+
+void ApplyPendingChanges(Context &ctx) {
+    ctx.current_scene.erase(ctx.to_destroy);
+    ctx.to_destroy.clear();
+
+    for (Object &obj : ctx.to_spawn) {
+        ctx.current_scene.push_back(std::move(obj));
+    }
+    ctx.to_spawn.clear();
+}
+
 void UpdateSceneState(Context &ctx) {
     switch (ctx.state) {
     case GameState::IS_DEAD:
@@ -41,11 +153,21 @@ void UpdateSceneState(Context &ctx) {
     }
 }
 
+// Заменяет текущую сцену копией prefab. Шаг симуляции, который обновил бы
+// ctx.prev_camera_pos, может ещё не выполниться (в меню шагов нет вовсе),
+// поэтому камера сразу встаёт в camera без интерполяции от положения в
+// прошлой сцене.
+static void SwitchScene(Context &ctx, const Scene &prefab, Vector2 camera) {
+    ctx.current_scene.ResetFrom(prefab);
+    ctx.camera_pos = camera;
+    ctx.prev_camera_pos = camera;
+}
+
 void UpdateGameState(Context &ctx) {
     switch (ctx.state) {
     case GameState::IS_ALIVE: {
         ctx.input_blocked = false;
-        Object &player = *find_player(ctx.current_scene);
+        ObjectRef player = *find_player(ctx.current_scene);
         if (CheckPlayerDeath(player, ctx.current_scene)) {
             ctx.state = GameState::IS_DEAD;
         }
@@ -60,10 +182,10 @@ void UpdateGameState(Context &ctx) {
             if (IsKeyPressed(KEY_R)) {
                 ctx.lives -= 1;
                 ctx.state = GameState::IS_ALIVE;
-                ctx.current_scene = ctx.scenes["game"];
+                SwitchScene(ctx, ctx.scenes["game"], ctx.camera_pos);
             }
         } else {
-            Object &player = *find_player(ctx.current_scene);
+            ObjectRef player = *find_player(ctx.current_scene);
             ctx.state = GameState::GAME_OVER;
             ApplyOnDeath(ctx, player);
         }
@@ -73,7 +195,7 @@ void UpdateGameState(Context &ctx) {
         ctx.input_blocked = true;
         if (IsKeyPressed(KEY_ENTER)) {
             ctx.state = GameState::MAIN_MENU;
-            ctx.current_scene = ctx.scenes["menu"];
+            SwitchScene(ctx, ctx.scenes["menu"], {0, 0});
         }
         break;
     }
@@ -81,21 +203,22 @@ void UpdateGameState(Context &ctx) {
         ctx.input_blocked = true;
         if (IsKeyPressed(KEY_ENTER)) {
             ctx.state = GameState::MAIN_MENU;
-            ctx.current_scene = ctx.scenes["menu"];
+            SwitchScene(ctx, ctx.scenes["menu"], {0, 0});
         }
         break;
     }
     case GameState::MAIN_MENU: {
         ctx.input_blocked = true;
         ctx.camera_pos = {0, 0};
+        ctx.prev_camera_pos = {0, 0};
 
         Rectangle startBtnCollider = {ctx.screen_size.x/2.0f - 250, ctx.screen_size.y/2.0f - 25, 200, 50};
 
-        ChangeButtonState(ctx, startBtnCollider, 1, "Assets/start_button1.png", "Assets/start_button2.png");
+        ChangeButtonState(ctx, startBtnCollider, 1);
 
         if (IsKeyPressed(KEY_ENTER) || (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && IsMouseOnButton(startBtnCollider))) {
             ctx.state = GameState::IS_ALIVE;
-            ctx.current_scene = ctx.scenes["game"];
+            SwitchScene(ctx, ctx.scenes["game"], {0, 0});
             ctx.lives = 3;
             ctx.score = 0;
             ctx.time = 0;
@@ -105,73 +228,46 @@ void UpdateGameState(Context &ctx) {
     }
 }
 
-void CreateObjectFromChar(
+// Создаёт объект уровня по его символу. Для неизвестных символов
+// возвращает std::nullopt.
+static std::optional<Object> CreateObjectFromSpawn(
     Context &ctx,
-    Scene &scene,
-    char ch,
-    float row,
-    float col,
+    const LevelSpawn &spawn,
     float scale_factor
 ) {
-    switch (ch) {
-    case '+': {
-        Object wall1 = Object();
-        wall1.position = Vector2{col, row} * scale_factor;
-        wall1.render = Render(
-            ctx,
-            "Assets/wall1.png",
-            Vector2{PIXEL_PER_UNIT, PIXEL_PER_UNIT} * scale_factor
-        );
-        wall1.collider = Collider(wall1.render);
-        scene.push_back(std::move(wall1));
-    } break;
-    case '=': {
-        Object wall1 = Object();
-        wall1.position = Vector2{col, row} * scale_factor;
-        wall1.render = Render(
-            ctx,
-            "Assets/wall2.png",
-            Vector2{PIXEL_PER_UNIT, PIXEL_PER_UNIT} * scale_factor
-        );
-        wall1.collider = Collider(wall1.render);
-        scene.push_back(std::move(wall1));
-    } break;
-    case '*': {
-        Object wall1 = Object();
-        wall1.position = Vector2{col, row} * scale_factor;
-        wall1.render = Render(
-            ctx,
-            "Assets/wall3.png",
-            Vector2{PIXEL_PER_UNIT, PIXEL_PER_UNIT} * scale_factor
-        );
-        wall1.collider = Collider(wall1.render);
-        scene.push_back(std::move(wall1));
-    } break;
+    const Vector2 position
+        = Vector2{float(spawn.col), float(spawn.row)} * scale_factor;
+    switch (spawn.kind) {
     case 'p': {
         Object player = Object();
-        player.position = Vector2{col, row} * scale_factor;
+        player.position = position;
         player.player = Player(10);
         player.render = Render(ctx, "Assets/player.png");
         player.collider = Collider(player.render, {ColliderType::DYNAMIC});
         player.physics.enabled = true;
         player.physics.mass = 60;
-        scene.push_back(std::move(player));
-    } break;
+        return player;
+    }
     case '1': {
         Object enemy_t1 = Object();
-        enemy_t1.position = Vector2{col, row} * scale_factor;
+        enemy_t1.position = position;
         enemy_t1.enemy.enabled = true;
         enemy_t1.enemy.speed = 2;
-        enemy_t1.render = Render(ctx, "Assets/enemy1.png");
+        if (!ctx.enemy_texture) {
+            ctx.enemy_texture = ctx.textures.MakeKey(
+                "Assets/enemy1.png", TextureResize::NONE, 0, 0
+            );
+        }
+        enemy_t1.render = Render(ctx, *ctx.enemy_texture);
         enemy_t1.collider = Collider(enemy_t1.render, {ColliderType::DYNAMIC});
         enemy_t1.physics.enabled = true;
         enemy_t1.physics.mass = 20;
-        scene.push_back(std::move(enemy_t1));
-    } break;
+        return enemy_t1;
+    }
     case 'f': {
         const float castle_scale = 3.0f;
         Object finish = Object();
-        finish.position = Vector2{col, row} * scale_factor;
+        finish.position = position;
         finish.position.y += castle_scale / 2.0f;
         finish.render = Render(
             ctx,
@@ -181,56 +277,395 @@ void CreateObjectFromChar(
         );
         finish.collider = Collider(finish.render, {ColliderType::EVENT});
         finish.finish.enabled = true;
-        scene.push_back(std::move(finish));
-    } break;
-    case ' ':
-        break;
+        return finish;
+    }
     default:
-        std::cerr << "Неизвестный тип объекта" << std::endl;
-        break;
+        // Неизвестные объекты отбрасывают ParseTextLevel и
+        // OpenCompiledLevel.
+        return std::nullopt;
     }
 }
 
 void ReadScene(Context &ctx, Scene &game_scene, std::string path) {
+    if (IsCompiledLevel(path)) {
+        MappedFile file;
+        LevelView level;
+        std::string error;
+        if (!file.Open(path) || !OpenCompiledLevel(file, level, error)) {
+            std::cerr << "Не удалось загрузить уровень " << path << ": "
+                      << error << std::endl;
+            return;
+        }
+        BuildScene(ctx, game_scene, level);
+        return;
+    }
+
     std::ifstream scene_file(path);
     std::stringstream ss;
     ss << scene_file.rdbuf();
-    std::string scene_data(ss.str());
+    LevelData level;
+    ParseTextLevel(ss.str(), level);
+    BuildScene(ctx, game_scene, level.View());
+}
+
+void BuildScene(Context &ctx, Scene &game_scene, const LevelView &level) {
+    const float scale_factor = level.cell_size;
+    Vector2 lvl_size = Vector2{float(level.width), float(level.height)}
+                       * scale_factor;
+
+    auto tiles = std::make_shared<TileMap>(
+        level.width, level.height, scale_factor
+    );
 
-    std::vector<std::vector<char>> lvl;
-    for (int j = 0; j < int(scene_data.size()); ++j) {
-        std::vector<char> line;
-        while (j < int(scene_data.size()) && scene_data[j] != '\n') {
-            line.push_back(scene_data[j]);
-            j += 1;
+    // Картинка фона не растягивается на весь уровень, иначе на длинных
+    // уровнях получалась бы огромная текстура, а повторяется вдоль него.
+    BackgroundLayer layer;
+    layer.texture = Render(ctx, level.textures[0]).texture;
+    layer.height = lvl_size.y;
+    tiles->backgrounds.push_back(layer);
+    Object background_layer = Object();
+    background_layer.gui_draw = DrawBackground;
+    game_scene.push_back(background_layer);
+
+    // Стены не становятся отдельными объектами, а записываются в карту
+    // стен, которую рисует этот объект.
+    Object tiles_layer = Object();
+    tiles_layer.gui_draw = DrawTileMap;
+    game_scene.push_back(tiles_layer);
+
+    const Vector2 tile_size
+        = Vector2{PIXEL_PER_UNIT, PIXEL_PER_UNIT} * scale_factor;
+    for (int kind = 1; kind <= LEVEL_WALL_KINDS; ++kind) {
+        Render wall = Render(ctx, level.textures[kind], tile_size);
+        tiles->textures.push_back(wall.texture);
+    }
+    // Сетка уже лежит в нужном порядке, поэтому копируется целиком.
+    std::copy(
+        level.tiles, level.tiles + tiles->cells.size(), tiles->cells.begin()
+    );
+    tiles->Bake();
+    game_scene.tiles = tiles;
+
+    if (!level_streaming) {
+        for (size_t i = 0; i < level.spawn_count; ++i) {
+            auto obj
+                = CreateObjectFromSpawn(ctx, level.spawns[i], scale_factor);
+            if (obj) {
+                game_scene.push_back(std::move(*obj));
+            }
+        }
+        return;
+    }
+
+    // Игрок нужен всегда, поэтому создаётся сразу, а остальные объекты
+    // раскладываются по кускам в порядке столбцов.
+    auto stream = std::make_shared<LevelStream>();
+    stream->cell_size = scale_factor;
+    int chunks = (level.width + STREAM_CHUNK_WIDTH - 1) / STREAM_CHUNK_WIDTH;
+    stream->chunk_start.assign(size_t(chunks) + 1, 0);
+    std::set<char> kinds;
+    for (size_t i = 0; i < level.spawn_count; ++i) {
+        const LevelSpawn &spawn = level.spawns[i];
+        if (spawn.kind == 'p') {
+            auto player = CreateObjectFromSpawn(ctx, spawn, scale_factor);
+            game_scene.push_back(std::move(*player));
+        } else if (spawn.col >= 0 && spawn.col < level.width) {
+            stream->chunk_start[spawn.col / STREAM_CHUNK_WIDTH + 1] += 1;
+            kinds.insert(spawn.kind);
+        }
+    }
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        stream->chunk_start[chunk + 1] += stream->chunk_start[chunk];
+    }
+    stream->spawns.resize(stream->chunk_start[chunks]);
+    std::vector<uint32_t> next(
+        stream->chunk_start.begin(), stream->chunk_start.end() - 1
+    );
+    for (size_t i = 0; i < level.spawn_count; ++i) {
+        const LevelSpawn &spawn = level.spawns[i];
+        if (spawn.kind != 'p' && spawn.col >= 0 && spawn.col < level.width) {
+            stream->spawns[next[spawn.col / STREAM_CHUNK_WIDTH]++] = spawn;
         }
-        lvl.push_back(line);
+    }
+    // Текстуры объектов загружаются сейчас, а не во время игры, чтобы
+    // первое появление объекта не вызывало задержку и чтобы они попали в
+    // атлас.
+    for (char kind : kinds) {
+        LevelSpawn spawn = {};
+        spawn.kind = kind;
+        CreateObjectFromSpawn(ctx, spawn, scale_factor);
+    }
+    game_scene.stream = stream;
+}
+
+void StreamLevel(Context &ctx) {
+    Scene &scene = ctx.current_scene;
+    if (!scene.stream) {
+        return;
+    }
+    const LevelStream &stream = *scene.stream;
+    if (scene.streamed.empty()) {
+        scene.streamed.assign(
+            stream.spawns.size(), StreamedObject{0, StreamedObject::UNLOADED}
+        );
+        scene.loaded.clear();
+        scene.moved.clear();
     }
 
-    std::reverse(lvl.begin(), lvl.end());
+    // Загружаем куски, которые видит камера, и по одному куску с каждой
+    // стороны. Выгружаем только объекты, которые отстоят ещё на один кусок
+    // дальше, чтобы при движении камеры туда-обратно на границе куска его
+    // объекты не создавались и не удалялись каждый шаг.
+    const float chunk_size = STREAM_CHUNK_WIDTH * stream.cell_size;
+    const float half_view = camera_view_size(ctx).x * 0.5f;
+    // Клетка с номером столбца col занимает [col - 0.5, col + 0.5] клеток.
+    const float left = ctx.camera_pos.x - half_view + stream.cell_size * 0.5f;
+    const float right = ctx.camera_pos.x + half_view + stream.cell_size * 0.5f;
+    int want_first = int(std::floor(left / chunk_size)) - 1;
+    int want_last = int(std::floor(right / chunk_size)) + 1;
+    want_first = std::max(want_first, 0);
+    want_last = std::min(want_last, stream.ChunkCount() - 1);
 
-    int lvl_height = int(lvl.size());
-    int lvl_width = 0;
-    for (const auto &line : lvl) {
-        lvl_width = std::max(lvl_width, int(line.size()));
+    // Объекты выгружаются по тому, где они находятся сейчас, а не по куску,
+    // в котором появились, иначе враг, который гонится за игроком, исчез бы
+    // прямо рядом с ним. Враг, убитый на этом шаге, ещё есть в сцене: его
+    // Destroy ждёт в ctx.to_destroy. Он тоже больше не должен появиться.
+    static std::vector<GameId> destroyed;
+    destroyed.assign(ctx.to_destroy.begin(), ctx.to_destroy.end());
+    std::sort(destroyed.begin(), destroyed.end());
+    size_t kept = 0;
+    for (uint32_t i : scene.loaded) {
+        StreamedObject &object = scene.streamed[i];
+        ObjectPtr obj = scene.find(object.id);
+        if (!obj
+            || std::binary_search(
+                destroyed.begin(), destroyed.end(), object.id
+            )) {
+            object.state = StreamedObject::GONE;
+            continue;
+        }
+        float x = obj->position.x + stream.cell_size * 0.5f;
+        int chunk = int(std::floor(x / chunk_size));
+        if (chunk < want_first - 1 || chunk > want_last + 1) {
+            // Объект вернётся, когда снова загрузится кусок, в котором он
+            // сейчас, даже если его собственный кусок всё это время виден.
+            chunk = std::clamp(chunk, 0, stream.ChunkCount() - 1);
+            object.state = StreamedObject::UNLOADED;
+            object.unloaded = true;
+            object.chunk = chunk;
+            object.position = obj->position;
+            if (i < stream.chunk_start[chunk]
+                || i >= stream.chunk_start[chunk + 1]) {
+                scene.moved.push_back(i);
+            }
+            Destroy(ctx, *obj);
+            continue;
+        }
+        scene.loaded[kept++] = i;
     }
+    scene.loaded.resize(kept);
+
+    auto create = [&](uint32_t i) {
+        StreamedObject &object = scene.streamed[i];
+        const LevelSpawn &spawn = stream.spawns[i];
+        auto obj = CreateObjectFromSpawn(ctx, spawn, stream.cell_size);
+        if (!obj) {
+            object.state = StreamedObject::GONE;
+            return;
+        }
+        if (object.unloaded) {
+            obj->position = object.position;
+        }
+        object.id = obj->id;
+        object.state = StreamedObject::LOADED;
+        scene.loaded.push_back(i);
+        Spawn(ctx, std::move(*obj));
+    };
 
-    const float scale_factor = 1.6f;
-    Vector2 lvl_size
-        = Vector2{float(lvl_width), float(lvl_height)} * scale_factor;
+    auto load = [&](int chunk) {
+        for (uint32_t i = stream.chunk_start[chunk];
+             i < stream.chunk_start[chunk + 1];
+             ++i) {
+            const StreamedObject &object = scene.streamed[i];
+            if (object.state == StreamedObject::UNLOADED
+                && (!object.unloaded || object.chunk == chunk)) {
+                create(i);
+            }
+        }
+        size_t left = 0;
+        for (uint32_t i : scene.moved) {
+            if (scene.streamed[i].chunk == chunk) {
+                create(i);
+            } else {
+                scene.moved[left++] = i;
+            }
+        }
+        scene.moved.resize(left);
+    };
 
-    Object bg0 = Object();
-    bg0.position = lvl_size * 0.5f - Vector2{0.5f, 0.5f} * scale_factor;
-    bg0.render
-        = Render(ctx, "Assets/background.png", lvl_size * PIXEL_PER_UNIT);
-    game_scene.push_back(bg0);
+    int first = std::max(scene.first_chunk, want_first - 1);
+    int last = std::min(scene.last_chunk, want_last + 1);
+    for (int chunk = want_first; chunk <= want_last; ++chunk) {
+        if (chunk < first || chunk > last) {
+            load(chunk);
+        }
+    }
+    // Оставшиеся куски лежат не дальше одного куска от нужных, поэтому
+    // вместе с ними загруженные куски снова идут подряд.
+    if (first > last) {
+        first = want_first;
+        last = want_last;
+    }
+    scene.first_chunk = std::min(first, want_first);
+    scene.last_chunk = std::max(last, want_last);
+}
 
-    for (int row = 0; row < int(lvl.size()); ++row) {
-        for (int col = 0; col < int(lvl[row].size()); ++col) {
-            const char ch = lvl[row][col];
-            CreateObjectFromChar(
-                ctx, game_scene, lvl[row][col], row, col, scale_factor
+void DrawBackground(Context &ctx) {
+    const TileMap &tiles = *ctx.current_scene.tiles;
+    const Vector2 view = camera_view_size(ctx);
+    // Левый нижний угол уровня - это угол клетки (0, 0).
+    const Vector2 origin = Vector2{-0.5f, -0.5f} * tiles.cell_size;
+    const float level_width = tiles.width * tiles.cell_size;
+    for (const BackgroundLayer &layer : tiles.backgrounds) {
+        const Rectangle &source = ctx.textures.entries[layer.texture].source;
+        if (layer.height <= 0 || source.height <= 0) {
+            continue;
+        }
+        const float width = layer.height * source.width / source.height;
+        // Сдвиг слоя относительно мира: при parallax < 1 слой частично
+        // следует за камерой.
+        const float shift = ctx.camera_pos.x * (1 - layer.parallax);
+        const float start = origin.x + shift;
+        const float left = ctx.camera_pos.x - view.x * 0.5f - start;
+        const float right = ctx.camera_pos.x + view.x * 0.5f - start;
+        int first = int(std::floor(left / width));
+        int last = int(std::floor(right / width));
+        // Слой с parallax = 1 покрывает только уровень, остальные нужны на
+        // всём экране, куда бы ни сдвинулась камера.
+        if (layer.parallax == 1) {
+            first = std::max(first, 0);
+            last = std::min(last, int(std::ceil(level_width / width)) - 1);
+        }
+        for (int i = first; i <= last; ++i) {
+            // Левый верхний угол копии слоя.
+            Vector2 pos = local_to_screen(
+                &ctx, Vector2{start + i * width, origin.y + layer.height}
+            );
+            Rectangle dest = {
+                pos.x,
+                pos.y,
+                width * PIXEL_PER_UNIT,
+                layer.height * PIXEL_PER_UNIT,
+            };
+            DrawTextureById(ctx, layer.texture, dest);
+        }
+    }
+}
+
+void TileMap::Bake() {
+    rects.clear();
+    std::fill(cell_rects.begin(), cell_rects.end(), -1);
+
+    // Жадно собираем прямоугольники: сначала растягиваем его вправо, пока
+    // идут свободные стены, а затем вверх, пока вся следующая строка такой же
+    // ширины состоит из свободных стен.
+    auto is_free = [this](int col, int row) {
+        return At(col, row) != 0 && cell_rects[size_t(row) * width + col] < 0;
+    };
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            if (!is_free(col, row)) {
+                continue;
+            }
+            int w = 1;
+            while (is_free(col + w, row)) {
+                w += 1;
+            }
+            int h = 1;
+            while (true) {
+                bool full_row = true;
+                for (int i = 0; i < w && full_row; ++i) {
+                    full_row = is_free(col + i, row + h);
+                }
+                if (!full_row) {
+                    break;
+                }
+                h += 1;
+            }
+
+            int id = int(rects.size());
+            for (int r = row; r < row + h; ++r) {
+                for (int c = col; c < col + w; ++c) {
+                    cell_rects[size_t(r) * width + c] = id;
+                }
+            }
+            TileRect rect;
+            rect.position = Vector2{col + (w - 1) * 0.5f, row + (h - 1) * 0.5f}
+                            * cell_size;
+            rect.width = w * cell_size;
+            rect.height = h * cell_size;
+            rects.push_back(rect);
+        }
+    }
+}
+
+void TileMap::CellRange(
+    Vector2 center,
+    Vector2 size,
+    int &col0,
+    int &row0,
+    int &col1,
+    int &row1
+) const {
+    col0 = int(std::floor((center.x - size.x * 0.5f) / cell_size + 0.5f));
+    col1 = int(std::floor((center.x + size.x * 0.5f) / cell_size + 0.5f));
+    row0 = int(std::floor((center.y - size.y * 0.5f) / cell_size + 0.5f));
+    row1 = int(std::floor((center.y + size.y * 0.5f) / cell_size + 0.5f));
+    col0 = std::max(col0, 0);
+    row0 = std::max(row0, 0);
+    col1 = std::min(col1, width - 1);
+    row1 = std::min(row1, height - 1);
+}
+
+void TileMap::Query(
+    Vector2 center,
+    Vector2 size,
+    std::vector<int> &out
+) const {
+    out.clear();
+    int col0, row0, col1, row1;
+    CellRange(center, size, col0, row0, col1, row1);
+    for (int row = row0; row <= row1; ++row) {
+        for (int col = col0; col <= col1; ++col) {
+            int id = cell_rects[size_t(row) * width + col];
+            if (id >= 0 && std::find(out.begin(), out.end(), id) == out.end()) {
+                out.push_back(id);
+            }
+        }
+    }
+}
+
+void DrawTileMap(Context &ctx) {
+    const TileMap &tiles = *ctx.current_scene.tiles;
+    // Рисуем только клетки, которые видит камера. Клетка рисуется вокруг
+    // своего центра, поэтому область расширяется на одну клетку.
+    Vector2 view = camera_view_size(ctx)
+                   + Vector2{tiles.cell_size, tiles.cell_size} * 2.0f;
+    int col0, row0, col1, row1;
+    tiles.CellRange(ctx.camera_pos, view, col0, row0, col1, row1);
+    for (int row = row0; row <= row1; ++row) {
+        for (int col = col0; col <= col1; ++col) {
+            uint8_t kind = tiles.At(col, row);
+            if (kind == 0) {
+                continue;
+            }
+            TextureId texture = tiles.textures[kind - 1];
+            const Rectangle &source = ctx.textures.entries[texture].source;
+            Vector2 pos = local_to_screen(
+                &ctx, Vector2{float(col), float(row)} * tiles.cell_size
             );
+            pos -= Vector2{source.width, source.height} * 0.5f;
+            DrawTextureById(ctx, texture, pos);
         }
     }
 }
@@ -243,11 +678,257 @@ bool operator!=(const Object &lhs, const Object &rhs) {
     return !(lhs == rhs);
 }
 
-Object *find_player(Scene &scene) {
-    for (auto &obj : scene) {
-        if (obj.player.enabled) {
-            return &obj;
+bool operator==(const ObjectRef &lhs, const ObjectRef &rhs) {
+    return (lhs.id == rhs.id);
+}
+
+bool operator!=(const ObjectRef &lhs, const ObjectRef &rhs) {
+    return !(lhs == rhs);
+}
+
+#ifdef MIT_GAME_CHECK_PLAYER
+// Находит игрока перебором всей сцены.
+static ObjectPtr scan_for_player(Scene &scene) {
+    for (size_t i = 0; i < scene.size(); ++i) {
+        if (scene.players[i].enabled) {
+            return scene[i];
         }
     }
-    return nullptr;
+    return ObjectPtr();
+}
+#endif
+
+ObjectPtr find_player(Scene &scene) {
+    ObjectPtr player;
+    if (scene.player_id) {
+        player = scene.find(*scene.player_id);
+    }
+#ifdef MIT_GAME_CHECK_PLAYER
+    ObjectPtr scanned = scan_for_player(scene);
+    assert(bool(player) == bool(scanned));
+    assert(!player || player->id == scanned->id);
+#endif
+    return player;
+}
+
+ObjectPtr Scene::find(GameId id) {
+    auto it = slots.find(id);
+    if (it == slots.end()) {
+        return ObjectPtr();
+    }
+    return (*this)[it->second];
+}
+
+// Возвращает номер, которого ещё не было ни у одного набора объектов.
+static uint64_t NextLayout() {
+    static uint64_t next_layout = 0;
+    return ++next_layout;
+}
+
+void Scene::push_back(Object obj) {
+    layout = NextLayout();
+    if (obj.player.enabled && !player_id) {
+        player_id = obj.id;
+    }
+    if (obj.enemy.enabled) {
+        enemy_slots.push_back(size());
+    }
+    if (obj.bullet.enabled) {
+        bullet_slots.push_back(size());
+    }
+    if (obj.finish.enabled) {
+        finish_slots.push_back(size());
+    }
+    if (obj.physics.enabled) {
+        physics_slots.push_back(size());
+    }
+    slots[obj.id] = size();
+    ids.push_back(obj.id);
+    enabled.push_back(obj.enabled);
+    positions.push_back(obj.position);
+    prev_positions.push_back(obj.position);
+    renders.push_back(std::move(obj.render));
+    colliders.push_back(obj.collider);
+    physics.push_back(obj.physics);
+    bullets.push_back(obj.bullet);
+    players.push_back(obj.player);
+    gui_draws.push_back(obj.gui_draw);
+    finishes.push_back(obj.finish);
+    enemies.push_back(obj.enemy);
+    sprites.push_back(obj.sprite);
+}
+
+void Scene::ResetFrom(const Scene &prefab) {
+    // Состояние, которое объекты меняют во время игры.
+    enabled = prefab.enabled;
+    positions = prefab.positions;
+    prev_positions = prefab.prev_positions;
+    renders = prefab.renders;
+    physics = prefab.physics;
+    bullets = prefab.bullets;
+    players = prefab.players;
+    sprites = prefab.sprites;
+    streamed = prefab.streamed;
+    loaded = prefab.loaded;
+    moved = prefab.moved;
+    first_chunk = prefab.first_chunk;
+    last_chunk = prefab.last_chunk;
+    if (layout == prefab.layout) {
+        return;
+    }
+
+    // С прошлого сброса объекты добавлялись или удалялись, поэтому
+    // остальное тоже нужно взять у шаблона.
+    layout = prefab.layout;
+    ids = prefab.ids;
+    slots = prefab.slots;
+    colliders = prefab.colliders;
+    gui_draws = prefab.gui_draws;
+    finishes = prefab.finishes;
+    enemies = prefab.enemies;
+    player_id = prefab.player_id;
+    tiles = prefab.tiles;
+    stream = prefab.stream;
+    enemy_slots = prefab.enemy_slots;
+    bullet_slots = prefab.bullet_slots;
+    finish_slots = prefab.finish_slots;
+    physics_slots = prefab.physics_slots;
+}
+
+void Scene::RebuildViews() {
+    layout = NextLayout();
+    enemy_slots.clear();
+    bullet_slots.clear();
+    finish_slots.clear();
+    physics_slots.clear();
+    for (size_t i = 0; i < size(); ++i) {
+        // Если игрока удалили, его место занимает следующий игрок сцены.
+        if (!player_id && players[i].enabled) {
+            player_id = ids[i];
+        }
+        if (enemies[i].enabled) {
+            enemy_slots.push_back(i);
+        }
+        if (bullets[i].enabled) {
+            bullet_slots.push_back(i);
+        }
+        if (finishes[i].enabled) {
+            finish_slots.push_back(i);
+        }
+        if (physics[i].enabled) {
+            physics_slots.push_back(i);
+        }
+    }
+}
+
+void Scene::erase(const std::vector<GameId> &ids_to_erase) {
+    if (ids_to_erase.empty()) {
+        return;
+    }
+    erase_mask.assign(size(), 0);
+    size_t first_removed = size();
+    for (GameId id : ids_to_erase) {
+        auto it = slots.find(id);
+        if (it == slots.end()) {
+            continue;
+        }
+        erase_mask[it->second] = 1;
+        first_removed = std::min(first_removed, it->second);
+        slots.erase(it);
+    }
+    if (first_removed == size()) {
+        return;
+    }
+
+    // erase_remap[slot - first_removed] - новый слот объекта, который
+    // остаётся в сцене.
+    erase_remap.resize(size() - first_removed);
+    size_t write = first_removed;
+    for (size_t read = first_removed; read < size(); ++read) {
+        erase_remap[read - first_removed] = write;
+        if (!erase_mask[read]) {
+            write += 1;
+        }
+    }
+    const std::vector<uint8_t> &removed = erase_mask;
+    ForEachArray([&removed, first_removed](auto &array) {
+        size_t write = first_removed;
+        for (size_t read = first_removed; read < array.size(); ++read) {
+            if (!removed[read]) {
+                array[write] = std::move(array[read]);
+                write += 1;
+            }
+        }
+        array.erase(array.begin() + write, array.end());
+    });
+    for (size_t i = first_removed; i < size(); ++i) {
+        slots[ids[i]] = i;
+    }
+    layout = NextLayout();
+    if (player_id && slots.count(*player_id) == 0) {
+        // Следующего игрока можно найти только перебором сцены.
+        player_id = std::nullopt;
+        RebuildViews();
+        return;
+    }
+    for (std::vector<size_t> *view :
+         {&enemy_slots, &bullet_slots, &finish_slots, &physics_slots}) {
+        size_t kept = 0;
+        for (size_t slot : *view) {
+            if (slot < first_removed) {
+                (*view)[kept++] = slot;
+            } else if (!removed[slot]) {
+                (*view)[kept++] = erase_remap[slot - first_removed];
+            }
+        }
+        view->resize(kept);
+    }
+}
+
+void DrawTextureById(Context &ctx, TextureId id, Vector2 pos) {
+    const TextureEntry &entry = ctx.textures.Get(id);
+    ctx.frame_stats.sprites_drawn += 1;
+    if (entry.texture.id != ctx.frame_stats.last_texture) {
+        ctx.frame_stats.texture_switches += 1;
+        ctx.frame_stats.last_texture = entry.texture.id;
+    }
+    DrawTextureRec(entry.texture, entry.source, pos, WHITE);
+}
+
+void DrawTextureById(Context &ctx, TextureId id, Rectangle dest) {
+    const TextureEntry &entry = ctx.textures.Get(id);
+    ctx.frame_stats.sprites_drawn += 1;
+    if (entry.texture.id != ctx.frame_stats.last_texture) {
+        ctx.frame_stats.texture_switches += 1;
+        ctx.frame_stats.last_texture = entry.texture.id;
+    }
+    DrawTexturePro(entry.texture, entry.source, dest, {0, 0}, 0, WHITE);
+}
+
+void DrawDebugInfo(Context &ctx) {
+    const FrameStats &stats = ctx.last_frame_stats;
+    const std::string lines[] = {
+        TextFormat("FPS: %d", GetFPS()),
+        TextFormat("Texture lookups: %d", stats.texture_lookups),
+        TextFormat("Texture fetches: %d", stats.texture_fetches),
+        TextFormat("Texture switches: %d", stats.texture_switches),
+        TextFormat("Sprites drawn: %d", stats.sprites_drawn),
+    };
+
+    const int font_size = 16;
+    const int padding = 6;
+    int width = 0;
+    for (const std::string &line : lines) {
+        width = std::max(width, MeasureText(line.c_str(), font_size));
+    }
+    int x = int(ctx.screen_size.x) - width - padding * 2;
+    int y = padding;
+    int height = int(std::size(lines)) * (font_size + 2) + padding * 2;
+    DrawRectangle(
+        x - padding, y - padding, width + padding * 2, height, Fade(BLACK, 0.6f)
+    );
+    for (const std::string &line : lines) {
+        DrawText(line.c_str(), x, y, font_size, GREEN);
+        y += font_size + 2;
+    }
 }
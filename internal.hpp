@@ -2,6 +2,12 @@
 
 #include <raylib.h>
 
+#include "hash.hpp"
+#include "jobs.hpp"
+#include "level.hpp"
+#include "sound.hpp"
+#include "texload.hpp"
+
 #include <iostream>
 #include <cstring>
 #include <memory>
@@ -10,26 +16,706 @@
 #include <map>
 #include <set>
 #include <array>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <map>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <unordered_map>
 
 const int PIXEL_PER_UNIT = 30;
 const float GRAVITY = 90.0f;
 
+// Если collision_broadphase равно true, функция FixCollisions ищет пары
+// объектов для проверки столкновений через равномерную сетку SpatialGrid.
+// Если false, то перебираются все пары объектов сцены, как описано в задании.
+// Второй вариант медленнее, но полезен, чтобы сверить с ним результат первого.
+extern bool collision_broadphase;
+
+// Если collision_islands равно true и FixCollisions получила пул потоков,
+// динамические объекты делятся на независимые группы (острова), которые
+// решаются в разных потоках. Если false, все объекты решаются по очереди в
+// одном потоке. Результат в обоих случаях одинаковый. Когда островов слишком
+// мало или у машины одно ядро, FixCollisions сама решает объекты по очереди:
+// там деление на острова только добавляет работы.
+extern bool collision_islands;
+
+// Если collision_islands_forced равно true, FixCollisions делит объекты на
+// острова при любом пуле потоков, даже там, где это только замедляет её.
+// Нужно для проверки островов на одноядерной машине (headless
+// --check-islands).
+extern bool collision_islands_forced;
+
+// Если level_streaming равно true, BuildScene не создаёт объекты уровня
+// сразу, а StreamLevel создаёт и удаляет их по мере движения камеры. Если
+// false, все объекты уровня создаются при загрузке.
+extern bool level_streaming;
+
+struct Context;
 struct Object;
 struct Render;
-typedef std::vector<Object> Scene;
+struct Collider;
+struct Physics;
+struct Bullet;
+struct Player;
+struct Finish;
+struct Enemy;
+struct SpriteState;
 typedef size_t GameId;
 typedef unsigned long long TextureHash;
+typedef int TextureId;
+typedef void (*GUIDrawer)(Context &);
 
 enum class GameState { IS_ALIVE, IS_DEAD, GAME_OVER, MAIN_MENU, FINISHED };
 
+// Прямоугольник из нескольких соседних стен, объединённых в одно тело.
+// position - центр прямоугольника, width и height - его размеры в метрах,
+// так же, как у объектов с коллайдером.
+struct TileRect {
+    Vector2 position;
+    float width, height;
+};
+
+// Структура BackgroundLayer описывает один слой фона. Картинка слоя
+// загружается в исходном размере, а при отрисовке растягивается до высоты
+// height метров с сохранением пропорций и повторяется по горизонтали, так
+// что размер текстуры не зависит от размера уровня.
+//
+// parallax задаёт, насколько слой сдвигается вслед за миром: при 1 слой
+// неподвижен относительно стен, при 0 - неподвижен относительно экрана.
+// Дальние слои с меньшим parallax движутся медленнее и создают ощущение
+// глубины.
+struct BackgroundLayer {
+    TextureId texture = -1;
+    float height = 0;
+    float parallax = 1;
+};
+
+// Структура TileMap хранит все стены уровня в виде сетки, где каждой клетке
+// уровня соответствует один байт: 0, если клетка пустая, и номер вида стены в
+// противном случае. Стены никогда не двигаются, поэтому делать из каждой
+// отдельный объект со своим коллайдером и проверять его каждый кадр в
+// FixCollisions невыгодно.
+//
+// После заполнения сетки функция Bake объединяет соседние стены в как можно
+// большие прямоугольники rects. Для каждой клетки запоминается номер
+// прямоугольника, в который она попала, поэтому найти все прямоугольники
+// рядом с объектом можно, просмотрев только клетки, которые он накрывает.
+//
+// Центр клетки (col, row) находится в точке (col, row) * cell_size.
+struct TileMap {
+    int width, height;
+    float cell_size;
+    std::vector<uint8_t> cells;
+    std::vector<int> cell_rects;
+    std::vector<TileRect> rects;
+    // Текстуры для каждого вида стены, textures[kind - 1].
+    std::vector<TextureId> textures;
+    // Слои фона, от дальнего к ближнему (см. DrawBackground).
+    std::vector<BackgroundLayer> backgrounds;
+
+    TileMap() : width(0), height(0), cell_size(1.0f) {}
+
+    TileMap(int width, int height, float cell_size)
+        : width(width)
+        , height(height)
+        , cell_size(cell_size)
+        , cells(size_t(width) * height, 0)
+        , cell_rects(size_t(width) * height, -1) {}
+
+    uint8_t At(int col, int row) const {
+        if (col < 0 || row < 0 || col >= width || row >= height) {
+            return 0;
+        }
+        return cells[size_t(row) * width + col];
+    }
+
+    void Set(int col, int row, uint8_t kind) {
+        cells[size_t(row) * width + col] = kind;
+    }
+
+    // Объединяет стены в прямоугольники. Вызывается один раз после того, как
+    // сетка заполнена.
+    void Bake();
+
+    // Записывает в out номера всех прямоугольников, которые лежат в клетках,
+    // накрытых прямоугольником с центром center и размерами size. Номера в
+    // out не повторяются.
+    void Query(Vector2 center, Vector2 size, std::vector<int> &out) const;
+
+    // Записывает в col0, row0, col1, row1 границы (включительно) клеток,
+    // накрытых прямоугольником с центром center и размерами size. Если
+    // прямоугольник не пересекается с картой, col0 > col1 или row0 > row1.
+    void CellRange(
+        Vector2 center,
+        Vector2 size,
+        int &col0,
+        int &row0,
+        int &col1,
+        int &row1
+    ) const;
+};
+
+// Число столбцов клеток в одном куске уровня (см. LevelStream).
+const int STREAM_CHUNK_WIDTH = 32;
+
+// Структура LevelStream хранит объекты уровня, разбитые на куски по
+// STREAM_CHUNK_WIDTH столбцов. Объекты куска chunk лежат в spawns с номерами
+// от chunk_start[chunk] до chunk_start[chunk + 1] - 1 в том же порядке, что и
+// в уровне.
+struct LevelStream {
+    float cell_size = 1.0f;
+    std::vector<LevelSpawn> spawns;
+    std::vector<uint32_t> chunk_start;
+
+    int ChunkCount() const {
+        return int(chunk_start.size()) - 1;
+    }
+};
+
+// Состояние одного объекта LevelStream в сцене.
+struct StreamedObject {
+    enum State : uint8_t {
+        // Объекта нет в сцене, он появится, когда загрузится его кусок.
+        UNLOADED,
+        // Объект есть в сцене с идентификатором id.
+        LOADED,
+        // Объект был уничтожен в игре и больше не появится.
+        GONE,
+    };
+
+    GameId id;
+    State state;
+    // Объект, который уже был в сцене и был выгружен, появится снова там,
+    // где его выгрузили: в позиции position, когда загрузится кусок chunk.
+    bool unloaded = false;
+    int32_t chunk = 0;
+    Vector2 position = {};
+};
+
+struct Scene;
+
+// Структура ObjectRef - ссылка на объект, который лежит в сцене. Компоненты
+// объектов хранятся в сцене не вместе, а в отдельных массивах (см. Scene),
+// поэтому ObjectRef содержит ссылки на компоненты объекта, а не сами
+// компоненты. Поля называются так же, как у Object, так что код, который
+// работал с Object &, без изменений работает и с ObjectRef: например,
+// obj.position.x += 1 изменит позицию объекта прямо в сцене.
+//
+// Обычный Object неявно превращается в ObjectRef, поэтому функции,
+// принимающие ObjectRef, можно вызывать и для объектов, которые ещё не
+// добавлены в сцену.
+//
+// Как и указатель на элемент std::vector, ObjectRef перестаёт быть
+// действительным, если в сцену добавляются или из неё удаляются объекты.
+struct ObjectRef {
+    bool &enabled;
+    GameId &id;
+    Vector2 &position;
+    Render &render;
+    Collider &collider;
+    Physics &physics;
+    Bullet &bullet;
+    Player &player;
+    GUIDrawer &gui_draw;
+    Finish &finish;
+    Enemy &enemy;
+    SpriteState &sprite;
+
+    ObjectRef(Object &obj);
+    ObjectRef(Scene &scene, size_t slot);
+
+    friend bool operator==(const ObjectRef &, const ObjectRef &);
+    friend bool operator!=(const ObjectRef &, const ObjectRef &);
+};
+
+// Класс ObjectPtr ведёт себя как указатель на объект сцены: его можно
+// проверить на пустоту и разыменовать через * или ->.
+class ObjectPtr {
+public:
+    ObjectPtr() {}
+
+    ObjectPtr(ObjectRef ref) : ref(ref) {}
+
+    ObjectPtr(const ObjectPtr &) = default;
+
+    // ObjectRef содержит ссылки, которые нельзя переназначить, поэтому при
+    // присваивании ссылка создаётся заново.
+    ObjectPtr &operator=(const ObjectPtr &other) {
+        ref.reset();
+        if (other.ref) {
+            ref.emplace(*other.ref);
+        }
+        return *this;
+    }
+
+    explicit operator bool() const {
+        return ref.has_value();
+    }
+
+    ObjectRef operator*() const {
+        return *ref;
+    }
+
+    const ObjectRef *operator->() const {
+        return &*ref;
+    }
+
+private:
+    std::optional<ObjectRef> ref;
+};
+
+// Структура SceneView - список тех объектов сцены, у которых включён
+// определённый компонент, например, только враги. По ней можно итерироваться
+// так же, как по самой сцене:
+//   for (ObjectRef enemy : scene.WithEnemy()) { ... }
+// Объекты перечисляются в том же порядке, что и в сцене.
+struct SceneView {
+    Scene *scene;
+    const std::vector<size_t> *slots;
+
+    struct iterator {
+        Scene *scene;
+        const size_t *slot;
+
+        ObjectRef operator*() const {
+            return ObjectRef(*scene, *slot);
+        }
+
+        iterator &operator++() {
+            slot += 1;
+            return *this;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return slot != other.slot;
+        }
+    };
+
+    iterator begin() const {
+        return iterator{scene, slots->data()};
+    }
+
+    iterator end() const {
+        return iterator{scene, slots->data() + slots->size()};
+    }
+
+    size_t size() const {
+        return slots->size();
+    }
+};
+
+// Сцена - это все объекты уровня, а также карта стен уровня.
+//
+// Объекты хранятся по компонентам: для каждого поля Object в сцене есть
+// отдельный массив, и i-е элементы всех массивов относятся к одному и тому
+// же объекту (i называется слотом объекта). Благодаря этому функции, которым
+// нужна только часть компонентов, например, только позиции и физика, читают
+// из памяти только эти компоненты, а не объекты целиком. По идентификатору
+// объекта его слот можно найти через slots.
+//
+// По сцене можно итерироваться так же, как по std::vector<Object>, только
+// элементами будут ObjectRef:
+//   for (ObjectRef obj : scene) { ... }
+//
+// Функциям, которым нужны только враги, пули, финиши или объекты с физикой,
+// не нужно перебирать всю сцену: для них сцена хранит списки слотов и отдаёт
+// их через WithEnemy, WithBullet, WithFinish и WithPhysics. Объект попадает
+// в список, если нужный компонент был включён, когда объект добавили в
+// сцену. Если компонент включается или выключается позже, нужно вызвать
+// RebuildViews.
+struct Scene {
+    std::vector<GameId> ids;
+    // std::vector<bool> не позволяет получить ссылку на свой элемент, а
+    // ObjectRef она нужна.
+    std::deque<bool> enabled;
+    std::vector<Vector2> positions;
+    // Позиции объектов до последнего шага симуляции. При отрисовке объект
+    // рисуется между prev_positions и positions, чтобы движение выглядело
+    // плавным, даже если шаги симуляции не совпадают с кадрами.
+    std::vector<Vector2> prev_positions;
+    std::vector<Render> renders;
+    std::vector<Collider> colliders;
+    std::vector<Physics> physics;
+    std::vector<Bullet> bullets;
+    std::vector<Player> players;
+    std::vector<GUIDrawer> gui_draws;
+    std::vector<Finish> finishes;
+    std::vector<Enemy> enemies;
+    std::vector<SpriteState> sprites;
+    std::unordered_map<GameId, size_t> slots;
+    // Идентификатор игрока, чтобы find_player не искала его перебором всей
+    // сцены. Обновляется в push_back, erase и RebuildViews.
+    std::optional<GameId> player_id;
+    // Карта стен никогда не меняется после ReadScene, поэтому все копии
+    // сцены ссылаются на одну и ту же карту, а не копируют её.
+    std::shared_ptr<const TileMap> tiles = std::make_shared<const TileMap>();
+    // Слоты объектов с включёнными компонентами, по возрастанию.
+    std::vector<size_t> enemy_slots;
+    std::vector<size_t> bullet_slots;
+    std::vector<size_t> finish_slots;
+    std::vector<size_t> physics_slots;
+    // Объекты уровня, которые подгружаются по мере движения камеры, или
+    // nullptr, если в сцене всё создано сразу. Как и карта стен, общие для
+    // всех копий сцены.
+    std::shared_ptr<const LevelStream> stream;
+    // Состояния объектов stream. Пустой массив означает, что ещё ничего не
+    // загружено; его заполняет первый вызов StreamLevel.
+    std::vector<StreamedObject> streamed;
+    // Номера объектов stream в состоянии LOADED.
+    std::vector<uint32_t> loaded;
+    // Номера выгруженных объектов stream, которые выгрузили не в их куске.
+    // Их кусок в stream их уже не вернёт, поэтому их ищут здесь.
+    std::vector<uint32_t> moved;
+    // Загруженные куски, от first_chunk до last_chunk включительно.
+    int first_chunk = 0, last_chunk = -1;
+    // Номер набора объектов сцены. Он меняется при каждом push_back и
+    // RebuildViews, а копия сцены получает тот же номер, что и оригинал.
+    // Если номера двух сцен совпадают, в них одни и те же объекты с одними
+    // и теми же коллайдерами, врагами и другими неизменяемыми компонентами.
+    uint64_t layout = 0;
+    // Рабочие массивы erase, чтобы не выделять память при каждом удалении.
+    std::vector<uint8_t> erase_mask;
+    std::vector<size_t> erase_remap;
+
+    struct iterator {
+        Scene *scene;
+        size_t slot;
+
+        ObjectRef operator*() const {
+            return ObjectRef(*scene, slot);
+        }
+
+        iterator &operator++() {
+            slot += 1;
+            return *this;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return slot != other.slot;
+        }
+    };
+
+    iterator begin() {
+        return iterator{this, 0};
+    }
+
+    iterator end() {
+        return iterator{this, size()};
+    }
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    ObjectRef operator[](size_t slot) {
+        return ObjectRef(*this, slot);
+    }
+
+    SceneView WithEnemy() {
+        return SceneView{this, &enemy_slots};
+    }
+
+    SceneView WithBullet() {
+        return SceneView{this, &bullet_slots};
+    }
+
+    SceneView WithFinish() {
+        return SceneView{this, &finish_slots};
+    }
+
+    SceneView WithPhysics() {
+        return SceneView{this, &physics_slots};
+    }
+
+    // Заново заполняет списки слотов для WithEnemy и остальных по текущим
+    // компонентам объектов.
+    void RebuildViews();
+
+    // Возвращает объект с идентификатором id или пустой ObjectPtr, если
+    // такого объекта в сцене нет. В отличие от ObjectRef, идентификатор не
+    // ломается при добавлении и удалении других объектов, поэтому его можно
+    // хранить между кадрами и каждый раз получать объект через find.
+    ObjectPtr find(GameId id);
+
+    // Раскладывает компоненты объекта по массивам сцены.
+    void push_back(Object obj);
+
+    // Возвращает сцену в состояние сцены-шаблона prefab, например, при
+    // перезапуске уровня. Карта стен не копируется, а берётся общая с
+    // шаблоном. Массивы изменяемых компонентов (позиции, физика, enabled и
+    // другие) копируются поверх уже выделенной памяти. Если с момента
+    // прошлого сброса объекты не добавлялись и не удалялись (layout совпадает
+    // с шаблоном), то таблица слотов и неизменяемые компоненты остаются
+    // прежними. Поэтому время перезапуска зависит только от числа объектов,
+    // а не от размера уровня.
+    void ResetFrom(const Scene &prefab);
+
+    // Удаляет объекты с переданными идентификаторами, сохраняя порядок
+    // остальных. Все объекты удаляются за один проход по массивам, поэтому
+    // удалить сразу много объектов так же дёшево, как и один. Повторяющиеся
+    // идентификаторы и идентификаторы объектов, которых нет в сцене,
+    // пропускаются. Списки слотов для WithEnemy и остальных не строятся
+    // заново, а только сдвигаются вслед за объектами.
+    void erase(const std::vector<GameId> &ids_to_erase);
+
+    void erase(GameId id) {
+        erase(std::vector<GameId>{id});
+    }
+
+    // Вызывает f для каждого массива компонентов. Удобно, когда одно и то же
+    // действие нужно выполнить над всеми массивами сразу.
+    template<typename F>
+    void ForEachArray(F f) {
+        f(ids);
+        f(enabled);
+        f(positions);
+        f(prev_positions);
+        f(renders);
+        f(colliders);
+        f(physics);
+        f(bullets);
+        f(players);
+        f(gui_draws);
+        f(finishes);
+        f(enemies);
+        f(sprites);
+    }
+};
+
+// Счётчики, которые помогают понять, сколько работы делается за кадр. Их
+// можно увидеть на экране, нажав F3 во время игры.
+struct FrameStats {
+    // Сколько раз текстура искалась по хешу.
+    int texture_lookups;
+    // Сколько раз текстура бралась по номеру TextureId.
+    int texture_fetches;
+    // Сколько раз при отрисовке объектов менялась текстура. Каждая смена
+    // текстуры заставляет raylib отправить накопленные вершины на видеокарту
+    // отдельным вызовом отрисовки.
+    int texture_switches;
+    // Сколько картинок нарисовано. Объекты за пределами экрана не рисуются
+    // и здесь не учитываются.
+    int sprites_drawn;
+    // Текстура, которой рисовали последней.
+    unsigned int last_texture;
+
+    FrameStats()
+        : texture_lookups(0)
+        , texture_fetches(0)
+        , texture_switches(0)
+        , sprites_drawn(0)
+        , last_texture(0) {}
+};
+
+// Текстура, зарегистрированная в TextureRegistry. Несколько маленьких
+// картинок могут лежать в одной большой текстуре-атласе, поэтому кроме самой
+// текстуры хранится прямоугольник source, в котором лежит картинка.
+struct TextureEntry {
+    Texture texture;
+    Rectangle source;
+};
+
+// Как картинка изменяется при загрузке: никак, масштабируется в scale раз
+// или растягивается до заданного размера.
+enum class TextureResize : uint8_t { NONE, SCALE, SIZE };
+
+// Полное описание текстуры: путь к картинке (номер строки в
+// TextureRegistry::paths) и то, как картинка изменяется при загрузке.
+// Две текстуры совпадают, только если совпадают все поля, кроме hash, а hash
+// нужен для быстрого поиска.
+struct TextureKey {
+    TextureHash hash;
+    uint32_t path;
+    TextureResize resize;
+    float width, height;
+
+    bool SameTexture(const TextureKey &other) const {
+        return path == other.path && resize == other.resize
+               && width == other.width && height == other.height;
+    }
+};
+
+// Время загрузки одной текстуры по этапам, в миллисекундах.
+struct TextureTiming {
+    uint32_t path;
+    double decode_ms, resize_ms, upload_ms;
+};
+
+// Структура TextureRegistry хранит все загруженные текстуры в одном
+// массиве. Каждая текстура получает номер (TextureId) - индекс в этом
+// массиве. Номер запоминается в Render, поэтому при отрисовке текстура
+// берётся из массива по индексу, а по хешу текстуры ищутся только при
+// создании Render.
+//
+// Хеш текстуры строится из хеша пути и параметров изменения картинки. Каждый
+// путь хешируется только один раз, при первой встрече: registry запоминает
+// его (paths) вместе с хешем. Если у двух разных текстур всё же совпадёт
+// хеш, Find не станет молча выдавать одну вместо другой, а завершит
+// программу с сообщением об ошибке.
+//
+// Если задан loader, Load не ждёт, пока картинка загрузится: она сразу
+// возвращает номер текстуры, размеры которой прочитаны из заголовка файла, а
+// саму картинку декодирует и масштабирует поток загрузчика. Пока картинка не
+// готова, текстура ничего не рисует. Готовые картинки загружает в
+// видеопамять Poll, которая вызывается в начале каждого кадра. Так первый
+// кадр меню показывается сразу, а текстуры уровня догружаются в фоне.
+//
+// После того, как все сцены созданы, вызывается BuildAtlas, которая собирает
+// все небольшие картинки в несколько больших текстур-атласов. Тогда объекты
+// с разными картинками рисуются из одной текстуры, и raylib может рисовать
+// их одним вызовом отрисовки.
+struct TextureRegistry {
+    // Атлас - квадрат со стороной ATLAS_SIZE пикселей. В атлас попадают
+    // картинки, у которых обе стороны не больше ATLAS_MAX_ITEM_SIZE.
+    static const int ATLAS_SIZE = 2048;
+    static const int ATLAS_MAX_ITEM_SIZE = 512;
+
+    std::vector<TextureEntry> entries;
+    // Описание каждой текстуры, keys[id] для entries[id].
+    std::vector<TextureKey> keys;
+    std::unordered_map<TextureHash, TextureId> ids;
+    // Все встреченные пути и их хеши, номер пути - индекс в этих массивах.
+    std::vector<std::string> paths;
+    std::vector<uint64_t> path_hashes;
+    std::unordered_map<std::string, uint32_t> path_ids;
+    // Копии картинок в оперативной памяти, которые ещё ждут попадания в
+    // атлас, по номерам текстур. Для остальных текстур data равно nullptr.
+    // После BuildAtlas массив пуст и больше не пополняется.
+    std::vector<Image> pending_images;
+    std::vector<Texture> atlases;
+    // Текстуры, добавленные после BuildAtlas, загружаются отдельно.
+    bool atlas_built = false;
+    // В headless-режиме окна и видеокарты нет, поэтому текстуры не
+    // загружаются: запоминаются только размеры картинок.
+    bool headless = false;
+    FrameStats *stats = nullptr;
+    std::unique_ptr<TextureLoader> loader;
+    // BuildAtlas была вызвана, пока картинки ещё загружались, и атлас
+    // соберёт Poll, когда загрузятся все картинки.
+    bool atlas_requested = false;
+    // Время загрузки каждой текстуры. Poll печатает его, когда загрузка
+    // заканчивается; reported - сколько записей уже напечатано.
+    std::vector<TextureTiming> timings;
+    size_t reported = 0;
+
+    // Возвращает описание текстуры из картинки path, изменённой так, как
+    // задают resize, width и height. Каждый вызов ищет path в path_ids,
+    // поэтому ключи текстур, которые нужны часто, лучше построить один раз и
+    // сохранить.
+    TextureKey MakeKey(
+        const std::string &path,
+        TextureResize resize,
+        float width,
+        float height
+    );
+
+    // Возвращает номер текстуры key или -1, если такой текстуры ещё нет.
+    TextureId Find(const TextureKey &key) {
+        if (stats) {
+            stats->texture_lookups += 1;
+        }
+        auto it = ids.find(key.hash);
+        if (it == ids.end()) {
+            return -1;
+        }
+        if (!keys[it->second].SameTexture(key)) {
+            ReportCollision(keys[it->second], key);
+        }
+        return it->second;
+    }
+
+    // Возвращает номер текстуры key, а если её ещё нет, загружает картинку
+    // и изменяет её так, как описано в key.
+    TextureId Load(const TextureKey &key);
+
+    // Загружает в видеопамять картинки, которые подготовил loader. Когда
+    // всё загружено, печатает время загрузки текстур.
+    void Poll();
+
+    // Загружает картинку image в видеопамять и возвращает номер получившейся
+    // текстуры. Registry забирает image себе, выгружать её не нужно.
+    TextureId Add(const TextureKey &key, Image image);
+
+    // Регистрирует текстуру размером width на height без картинки. Нужна
+    // только в headless-режиме, где картинки не загружаются в видеопамять.
+    TextureId AddBlank(const TextureKey &key, int width, int height);
+
+    // Собирает все ожидающие картинки в атласы. Отдельные текстуры этих
+    // картинок после этого выгружаются. Если loader ещё загружает картинки,
+    // атлас будет собран в Poll после их загрузки.
+    void BuildAtlas();
+
+    const TextureEntry &Get(TextureId id) {
+        if (stats) {
+            stats->texture_fetches += 1;
+        }
+        return entries[id];
+    }
+
+private:
+    // Регистрирует текстуру размером width на height, картинку которой
+    // загрузит loader.
+    TextureId AddAsync(const TextureKey &key, int width, int height);
+    void PrintTimings();
+
+    // Сообщает о совпадении хешей двух разных текстур и завершает программу.
+    [[noreturn]] void
+    ReportCollision(const TextureKey &existing, const TextureKey &added);
+};
+
+// Структура Input позволяет подменить источник нажатий клавиш. В обычной
+// игре это клавиатура, а в headless-режиме - заранее заданный сценарий.
+//
+// Симуляция может делать несколько шагов за один кадр или ни одного, поэтому
+// IsKeyPressed, которая срабатывает один раз за кадр, для неё не подходит.
+// KeyPressed сравнивает состояние клавиши с состоянием на прошлом шаге
+// симуляции, так что каждое нажатие засчитывается ровно один раз.
+struct Input {
+    bool (*key_down)(int key) = IsKeyDown;
+
+    bool KeyDown(int key) const {
+        return key_down(key);
+    }
+
+    // Возвращает true, если клавиша зажата сейчас, но не была зажата при
+    // прошлом вызове KeyPressed для неё же. Поэтому за один шаг симуляции
+    // каждую клавишу стоит проверять через KeyPressed только один раз.
+    bool KeyPressed(int key) {
+        bool down = key_down(key);
+        if (key < 0 || key >= int(was_down.size())) {
+            return down;
+        }
+        bool pressed = down && !was_down[key];
+        was_down[key] = down;
+        return pressed;
+    }
+
+private:
+    std::array<bool, 512> was_down = {};
+};
+
+// Изменения сцены, которые функции Spawn и Destroy откладывают до конца шага.
+struct PendingChanges {
+    std::vector<GameId> to_destroy;
+    std::vector<Object> to_spawn;
+};
+
+// Пока поток выполняет свою часть ParallelForEach, Spawn и Destroy пишут не
+// в общие списки Context, а в список этого потока, на который указывает
+// deferred_changes. Так потокам не нужно ждать друг друга.
+extern thread_local PendingChanges *deferred_changes;
+
 // Структура Context, в которой хранятся некоторые переменные текущего состояния
 // игры. При реализации своих функций вам понадобятся не все поля, но, я думаю,
 // по названиям большинства этих переменных можно понять что в них хранится.
 struct Context {
     Vector2 camera_pos;
+    // Положение камеры до последнего шага симуляции, см. prev_positions в
+    // Scene.
+    Vector2 prev_camera_pos;
     Vector2 screen_size;
     int lives;
     std::unique_ptr<Render> heart;
@@ -37,11 +723,34 @@ struct Context {
     uint64_t time;
     GameState state;
     bool input_blocked;
-    std::map<TextureHash, Texture> textures_storage;
+    Input input;
+    // Сколько шагов симуляции делается за одну секунду игрового времени.
+    // Не зависит от частоты кадров.
+    int physics_hz;
+    TextureRegistry textures;
+    // Звуковые эффекты. Загружаются один раз при запуске игры, а номера
+    // нужных звуков запоминаются в полях *_sound. В headless-режиме звуки не
+    // загружаются и номера равны -1.
+    SoundBank sounds;
+    SoundId shot_sound = -1;
+    SoundId death_sound = -1;
+    SoundId enemy_death_sound = -1;
+    // Ключи текстур объектов, которые создаются во время игры: пуль и
+    // врагов из подгружаемых кусков уровня. Строятся при создании первого
+    // такого объекта (см. Render).
+    std::optional<TextureKey> bullet_texture;
+    std::optional<TextureKey> enemy_texture;
+    // Счётчики текущего и предыдущего кадров.
+    FrameStats frame_stats;
+    FrameStats last_frame_stats;
+    bool show_debug;
     std::vector<GameId> to_destroy;
     std::vector<Object> to_spawn;
+    // Потоки для ParallelForEach. Если jobs пуст, всё выполняется в
+    // основном потоке.
+    std::unique_ptr<JobSystem> jobs;
     Scene current_scene;
-    std::map<std::string, std::vector<Object>> scenes;
+    std::map<std::string, Scene> scenes;
 };
 
 // Реализации следующих функций находятся в файле internal.cpp.
@@ -51,12 +760,44 @@ struct Context {
 // Для выполнения своих задания эта функция вам не нужна.
 Vector2 local_to_screen(Context *, Vector2 point);
 
+// Функция camera_view_size возвращает размеры области, которую видит камера,
+// в игровых единицах. Центр этой области находится в ctx.camera_pos.
+Vector2 camera_view_size(const Context &);
+
+// Функция IsOnScreen проверяет, попадает ли на экран хотя бы часть
+// прямоугольника с центром center и размерами size (в игровых единицах).
+bool IsOnScreen(const Context &, Vector2 center, Vector2 size);
+
+// Функция StepGame продвигает игру на dt секунд: обрабатывает ввод игрока,
+// гравитацию, врагов, пули и столкновения, двигает камеру и применяет
+// отложенные Spawn и Destroy. Ничего не рисует, поэтому работает и без окна.
+void StepGame(Context &ctx, float dt);
+
+// Функция ParallelForEach вызывает update для каждого объекта view,
+// распределяя объекты между потоками ctx.jobs. update может менять только
+// сам объект, который ей передан, и читать остальную сцену. Spawn и Destroy
+// внутри update разрешены: потоки копят их отдельно, а в конце они
+// добавляются в ctx.to_spawn и ctx.to_destroy в том же порядке, в каком их
+// добавил бы обычный цикл по view. Поэтому результат не отличается от
+// обычного цикла ни на бит, сколько бы ни было потоков. Только
+// идентификаторы объектов, созданных внутри update, могут идти в другом
+// порядке: счётчик идентификаторов общий для всех потоков.
+//
+// Render внутри update создавать нельзя: TextureRegistry не защищён от
+// одновременного доступа. Ключ или Render для нового объекта нужно
+// подготовить заранее в основном потоке.
+void ParallelForEach(
+    Context &ctx,
+    SceneView view,
+    const std::function<void(ObjectRef)> &update
+);
+
 // Функция Destroy получает в качестве аргументов контекст игры и объект,
 // который необходимо удалить. Так как во многих функциях происходит
 // итерация по списку объектов в сцене, то объект нельзя добавить в сцену сразу
 // же при вызове функции. Поэтому она помещает объект в список to_destroy,
 // из которого объект удалится в конце отрисовки кадра.
-void Destroy(Context &ctx, Object &obj);
+void Destroy(Context &ctx, ObjectRef obj);
 
 // Функция Destroy получает в качестве аргументов контекст игры и объект,
 // который необходимо добавить в сцена. Работает аналогично функции Destroy,
@@ -64,6 +805,11 @@ void Destroy(Context &ctx, Object &obj);
 // взаимодействовать с ним получится только на следующем кадре.
 void Spawn(Context &ctx, Object obj);
 
+// Функция ApplyPendingChanges удаляет из текущей сцены все объекты из
+// списка to_destroy и добавляет все объекты из списка to_spawn, после чего
+// очищает оба списка. Вызывается в конце каждого кадра.
+void ApplyPendingChanges(Context &ctx);
+
 // Функция UpdateSceneState просто вызывает функцию отрисовки некоторого
 // экрана, соответствующего текущему состоянию игры. Например, если игрок
 // пришёл к финишу, вызовется функция DrawFinishScreen, и т.д.
@@ -76,22 +822,66 @@ void UpdateSceneState(Context &);
 void UpdateGameState(Context &);
 
 // Функция find_player находит объект со включённым компонентом Player в
-// переданной сцене и возвращает указатель на него. Возвращается именно
-// указатель для того, чтобы изменения, которые вносятся в этот объект
+// переданной сцене и возвращает указатель на него (ObjectPtr). Возвращается
+// именно указатель для того, чтобы изменения, которые вносятся в этот объект
 // действительно применялись к игроку. Иначе, возвращалась бы копия и
 // изменения бы не применялись.
 //
-// Такая реализация не очень безопасна, так как Scene (которая на самом деле
-// std::vector<Object>) может динамически менять свой размер и из-за этого
-// указатель может сломаться. Поэтому важно каждый раз вызывать эту функцию
-// заново, а не сохранять её результат для дальнейшего использования.
-Object *find_player(Scene &);
+// Такая реализация не очень безопасна, так как массивы компонентов Scene
+// могут динамически менять свой размер и из-за этого указатель может
+// сломаться. Поэтому важно каждый раз вызывать эту функцию заново, а не
+// сохранять её результат для дальнейшего использования.
+//
+// Сама функция работает за O(1): сцена запоминает идентификатор игрока
+// (Scene::player_id), когда он добавляется, и находит его по этому
+// идентификатору. Если собрать игру с опцией MIT_GAME_CHECK_PLAYER, результат
+// дополнительно сверяется с поиском перебором всей сцены.
+ObjectPtr find_player(Scene &);
 
 // Функция ReadScene считывает сцену из файла по переданному пути. Эта функция
 // также вызывается только при инициализации игры, поэтому не будем её
-// подробно описывать
+// подробно описывать. Файл может быть как текстовым уровнем, так и
+// скомпилированным (см. level.hpp).
 void ReadScene(Context &, Scene &, std::string path);
 
+// Функция BuildScene добавляет в сцену фон, стены и объекты уровня level.
+// Если включён level_streaming, объекты, кроме игрока, не создаются сразу, а
+// записываются в Scene::stream.
+void BuildScene(Context &, Scene &, const LevelView &level);
+
+// Функция StreamLevel создаёт объекты кусков уровня, которые оказались рядом
+// с камерой, и удаляет объекты, которые сейчас находятся далеко позади или
+// впереди. Объекты создаются через Spawn и удаляются через Destroy, поэтому в
+// сцене они появятся после ApplyPendingChanges. Уничтоженные в игре объекты
+// (например, убитые враги) при повторной загрузке куска не появляются.
+//
+// Благодаря этому число объектов в сцене зависит от размера экрана, а не от
+// длины уровня.
+void StreamLevel(Context &);
+
+// Функция DrawBackground рисует слои фона уровня (TileMap::backgrounds),
+// повторяя каждый вдоль уровня в той части, которую видит камера. Рисуется
+// первой, под стенами.
+void DrawBackground(Context &);
+
+// Функция DrawTileMap рисует стены текущей сцены. ReadScene добавляет в сцену
+// объект с gui_draw = DrawTileMap сразу после фона, поэтому стены рисуются
+// поверх фона, но под всеми остальными объектами.
+void DrawTileMap(Context &);
+
+// Функция DrawTextureById рисует текстуру с номером id так, чтобы её левый
+// верхний угол оказался в точке pos экрана. Все объекты рисуются через неё,
+// чтобы учитывать смены текстур в Context::frame_stats.
+void DrawTextureById(Context &, TextureId id, Vector2 pos);
+
+// То же самое, но текстура растягивается на прямоугольник dest экрана.
+void DrawTextureById(Context &, TextureId id, Rectangle dest);
+
+// Функция DrawDebugInfo рисует в углу экрана счётчики из
+// Context::last_frame_stats. Вызывается, если включён Context::show_debug
+// (переключается клавишей F3).
+void DrawDebugInfo(Context &);
+
 // Далее следуют компоненты всех игровых объектов. У большинства из них
 // тривиальные конструкторы, поэтому комментарии есть только к тем объектам,
 // которые при конструировании делают не только присвоение переменных.
@@ -102,101 +892,65 @@ void ReadScene(Context &, Scene &, std::string path);
 //
 // Одной из заметных частей является тот факт, что объекты Render не хранят
 // в себе сами текстуры, которые им соответствуют. Вместо этого они хранят
-// некоторый хеш текстуры, который вычисляется в каждом из конструкторов.
-// Сами же текстуры добавляются в поле Context::textures_storage. Сделано это
-// для того, чтобы для разных объектов с одинаковыми текстурами эти самые
-// текстуры не загружались по несколько раз. Таким образом, экономится некоторое
-// количество оперативной памяти и добавляется немного производительности при
-// загрузке текстур.
+// номер текстуры в Context::textures. При создании Render по пути к картинке
+// строится ключ текстуры (см. TextureRegistry::MakeKey), и если текстура с
+// таким ключом уже загружена, то берётся её номер.
+// Сделано это для того, чтобы для разных объектов с одинаковыми текстурами
+// эти самые текстуры не загружались по несколько раз. Таким образом,
+// экономится некоторое количество оперативной памяти и добавляется немного
+// производительности при загрузке текстур.
+//
+// Для построения ключа путь к картинке приходится искать в таблице путей.
+// Объекты, которые создаются во время игры (например, пули), строят ключ
+// один раз и дальше создают Render сразу по ключу.
 struct Render {
     bool visible;
     float width, height;
-    std::string path;
-    TextureHash hash;
+    TextureId texture;
 
-    // Самый простой конструктор. Загружает переданный файл с текстурой и
-    // никак его не изменяет.
-    Render(Context &ctx, std::string filename) : visible(true) {
-        hash = CalculateTextureHash(filename, 0, 0);
-        if (ctx.textures_storage.count(hash) == 0) {
-            Texture tex = LoadTexture(filename.c_str());
-            ctx.textures_storage[hash] = std::move(tex);
+    // Берёт текстуру по готовому ключу key. Размер в пикселях берётся из
+    // ключа, если картинка растягивается до заданного размера, и из самой
+    // текстуры в остальных случаях.
+    Render(Context &ctx, const TextureKey &key) : visible(true) {
+        texture = ctx.textures.Load(key);
+        if (key.resize == TextureResize::SIZE) {
+            width = key.width;
+            height = key.height;
+        } else {
+            const Rectangle &source = ctx.textures.entries[texture].source;
+            width = source.width;
+            height = source.height;
         }
-        Texture tex = ctx.textures_storage[hash];
-        width = float(tex.width);
-        height = float(tex.height);
-        path = filename;
     }
 
+    // Самый простой конструктор. Загружает переданный файл с текстурой и
+    // никак его не изменяет.
+    Render(Context &ctx, const std::string &filename)
+        : Render(
+              ctx, ctx.textures.MakeKey(filename, TextureResize::NONE, 0, 0)
+          ) {}
+
     // Наиболее используемый конструктор. При загрузке текстуры он также
     // масшатбирует её размер на переданное значение scale. Если scale < 1,
     // то текстура уменьшается, иначе - увеличивается.
-    Render(Context &ctx, std::string filename, float scale) : visible(true) {
-        hash = CalculateTextureHash(filename, scale, 0.0f);
-        if (ctx.textures_storage.count(hash) == 0) {
-            Image img = LoadImage(filename.c_str());
-            ImageResize(&img, img.width * scale, img.height * scale);
-            Texture tex = LoadTextureFromImage(img);
-            UnloadImage(img);
-            ctx.textures_storage[hash] = std::move(tex);
-        }
-        Texture tex = ctx.textures_storage[hash];
-        path = filename;
-        width = tex.width;
-        height = tex.height;
-    }
+    Render(Context &ctx, const std::string &filename, float scale)
+        : Render(
+              ctx,
+              ctx.textures.MakeKey(filename, TextureResize::SCALE, scale, 0)
+          ) {}
 
     // Данный конструктор при загрузке текстура изменяет её размер в пикселях на
     // указанный в параметре size. В отличие от конструктора со scale, не
     // сохраняет оригинальное соотношение сторон картинки.
-    Render(Context &ctx, std::string filename, Vector2 size) : visible(true) {
-        hash = CalculateTextureHash(filename, size.x, size.y);
-        if (ctx.textures_storage.count(hash) == 0) {
-            Image img = LoadImage(filename.c_str());
-            ImageResize(&img, size.x, size.y);
-            Texture tex = LoadTextureFromImage(img);
-            UnloadImage(img);
-            ctx.textures_storage[hash] = std::move(tex);
-        }
-        Texture tex = ctx.textures_storage[hash];
-        path = filename;
-        width = size.x;
-        height = size.y;
-    }
+    Render(Context &ctx, const std::string &filename, Vector2 size)
+        : Render(
+              ctx,
+              ctx.textures.MakeKey(
+                  filename, TextureResize::SIZE, size.x, size.y
+              )
+          ) {}
 
-    Render() : visible(false) {}
-
-private:
-    // Вычисляет хэш по переданным параметрам. Для вычисления используется
-    // очень простой алгоритм Adler32.
-    TextureHash
-    CalculateTextureHash(std::string path, float width, float height) {
-        const char *path_bytes = path.c_str();
-        char *width_bytes = reinterpret_cast<char *>(&width);
-        char *height_bytes = reinterpret_cast<char *>(&height);
-
-        uint64_t mod64 = 4'294'967'291;
-        size_t path_len = strlen(path_bytes);
-        uint64_t s1 = 1;
-        uint64_t s2 = 0;
-
-        for (int i = 0; i < path_len; ++i) {
-            s1 = (s1 + path_bytes[i]) % mod64;
-            s2 = (s2 + s1) % mod64;
-        }
-
-        for (int i = 0; i < 4; ++i) {
-            s1 = (s1 + width_bytes[i]) % mod64;
-            s2 = (s2 + s1) % mod64;
-        }
-
-        for (int i = 0; i < 4; ++i) {
-            s1 = (s1 + height_bytes[i]) % mod64;
-            s2 = (s2 + s1) % mod64;
-        }
-
-        return (s2 << 32) | s1;
-    }
+    Render() : visible(false), texture(-1) {}
 };
 
 // Перечисление всех типов коллайдеров.
@@ -219,7 +973,7 @@ struct Collider {
     bool enabled;
     float width, height;
 
-    Collider() : enabled(false), types({}), width(0), height(0) {}
+    Collider() : enabled(false), width(0), height(0), types(0) {}
 
     // В параметр types передаётся множество тех типов, которым должен
     // соответствовать коллайдеры. Нескольким типам коллайдеров, например,
@@ -228,17 +982,26 @@ struct Collider {
         Render &render, std::set<ColliderType> types = {ColliderType::STATIC}
     )
         : enabled(true)
-        , types(types) {
+        , types(0) {
         width = render.width * 1.0f / PIXEL_PER_UNIT;
         height = render.height * 1.0f / PIXEL_PER_UNIT;
+        for (ColliderType type : types) {
+            this->types |= TypeBit(type);
+        }
     }
 
-    bool of_type(ColliderType type) {
-        return types.count(type) != 0;
+    bool of_type(ColliderType type) const {
+        return (types & TypeBit(type)) != 0;
     }
 
 private:
-    std::set<ColliderType> types;
+    // Типы хранятся битовой маской, а не std::set, чтобы коллайдер было
+    // дёшево копировать и хранить в массиве компонентов сцены.
+    uint8_t types;
+
+    static uint8_t TypeBit(ColliderType type) {
+        return uint8_t(1u << int(type));
+    }
 };
 
 // Структура, возвращаемая функцией CheckCollision. Поле exists равно false,
@@ -260,6 +1023,17 @@ struct Collision {
     Vector2 overlap;
 };
 
+// Структура, возвращаемая функцией SweepCollision. Поле exists равно true,
+// если первый объект, двигаясь по прямой, заденет второй. В таком случае time
+// - доля пути от 0 до 1, пройдя которую объект коснётся второго, а normal -
+// единичная нормаль к стороне второго объекта, которой коснулся первый.
+// Например, если объект падает на пол, то normal равна {0, 1}.
+struct SweptCollision {
+    bool exists;
+    float time;
+    Vector2 normal;
+};
+
 struct Physics {
     bool enabled;
     bool can_jump;
@@ -305,8 +1079,6 @@ struct Player {
         , direction(Direction::RIGHT) {}
 };
 
-typedef void (*GUIDrawer)(Context &);
-
 struct Finish {
     bool enabled;
 
@@ -320,6 +1092,50 @@ struct Enemy {
     Enemy() : enabled(false), speed(0.0f) {}
 };
 
+// Структура SpriteState позволяет объекту переключаться между несколькими
+// картинками одного размера, например, обычной кнопкой и кнопкой под
+// курсором. Номера текстур всех состояний находятся один раз при создании
+// объекта, а Set только подменяет номер текстуры в Render, поэтому смена
+// состояния не загружает картинки и не выделяет память. Если состояние не
+// изменилось, Set вообще ничего не делает.
+struct SpriteState {
+    static const int MAX_STATES = 3;
+
+    bool enabled;
+    int current;
+    std::array<TextureId, MAX_STATES> textures;
+
+    SpriteState() : enabled(false), current(0) {
+        textures.fill(-1);
+    }
+
+    // Состояние с номером i рисуется текстурой states[i].texture. В начале
+    // объект находится в состоянии 0.
+    SpriteState(std::initializer_list<Render> states)
+        : enabled(true)
+        , current(0) {
+        textures.fill(-1);
+        int i = 0;
+        for (const Render &state : states) {
+            if (i < MAX_STATES) {
+                textures[i++] = state.texture;
+            }
+        }
+    }
+
+    // Переводит объект в состояние state и меняет текстуру render. Возвращает
+    // true, если состояние изменилось.
+    bool Set(int state, Render &render) {
+        if (state == current || state < 0 || state >= MAX_STATES
+            || textures[state] < 0) {
+            return false;
+        }
+        current = state;
+        render.texture = textures[state];
+        return true;
+    }
+};
+
 struct Object {
     bool enabled;
     GameId id;
@@ -332,6 +1148,7 @@ struct Object {
     GUIDrawer gui_draw;
     Finish finish;
     Enemy enemy;
+    SpriteState sprite;
 
     Object()
         : enabled(true)
@@ -343,11 +1160,41 @@ struct Object {
         , player(Player())
         , gui_draw(nullptr)
         , finish(Finish())
-        , enemy(Enemy()) {
-        static GameId next_id = 0;
-        this->id = next_id++;
+        , enemy(Enemy())
+        , sprite(SpriteState()) {
+        // Объекты могут создаваться в потоках ParallelForEach.
+        static std::atomic<GameId> next_id = 0;
+        this->id = next_id.fetch_add(1, std::memory_order_relaxed);
     }
 
     friend bool operator==(const Object &, const Object &);
     friend bool operator!=(const Object &, const Object &);
 };
+
+inline ObjectRef::ObjectRef(Object &obj)
+    : enabled(obj.enabled)
+    , id(obj.id)
+    , position(obj.position)
+    , render(obj.render)
+    , collider(obj.collider)
+    , physics(obj.physics)
+    , bullet(obj.bullet)
+    , player(obj.player)
+    , gui_draw(obj.gui_draw)
+    , finish(obj.finish)
+    , enemy(obj.enemy)
+    , sprite(obj.sprite) {}
+
+inline ObjectRef::ObjectRef(Scene &scene, size_t slot)
+    : enabled(scene.enabled[slot])
+    , id(scene.ids[slot])
+    , position(scene.positions[slot])
+    , render(scene.renders[slot])
+    , collider(scene.colliders[slot])
+    , physics(scene.physics[slot])
+    , bullet(scene.bullets[slot])
+    , player(scene.players[slot])
+    , gui_draw(scene.gui_draws[slot])
+    , finish(scene.finishes[slot])
+    , enemy(scene.enemies[slot])
+    , sprite(scene.sprites[slot]) {}
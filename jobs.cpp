@@ -0,0 +1,108 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+
+JobSystem::JobSystem(int workers) {
+    workers = std::max(workers, 0);
+    for (int i = 0; i <= workers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i <= workers; ++i) {
+        threads.emplace_back(&JobSystem::WorkerLoop, this, size_t(i));
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void JobSystem::ParallelFor(
+    size_t count,
+    const std::function<void(size_t begin, size_t end, size_t chunk)> &body
+) {
+    size_t chunks = ChunkCount(count);
+    if (chunks <= 1 || threads.empty()) {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            size_t begin = chunk * GRAIN;
+            body(begin, std::min(begin + GRAIN, count), chunk);
+        }
+        return;
+    }
+
+    std::atomic<size_t> remaining{chunks};
+    // Счётчик увеличивается до того, как задачи попадут в очереди, иначе
+    // поток мог бы забрать задачу раньше, чем её учли, и уменьшить счётчик
+    // ниже нуля.
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued += chunks;
+    }
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        size_t begin = chunk * GRAIN;
+        Task task = {
+            &body, begin, std::min(begin + GRAIN, count), chunk, &remaining
+        };
+        Queue &queue = *queues[chunk % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+    wake.notify_all();
+
+    Task task;
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (TryPop(0, task)) {
+            Run(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::WorkerLoop(size_t self) {
+    Task task;
+    while (true) {
+        if (TryPop(self, task)) {
+            Run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+bool JobSystem::TryPop(size_t self, Task &task) {
+    // Из своей очереди задачи берутся с конца, а из чужих - с начала, чтобы
+    // владелец очереди и крадущий поток реже мешали друг другу.
+    for (size_t i = 0; i < queues.size(); ++i) {
+        Queue &queue = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        } else {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        queued -= 1;
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::Run(const Task &task) {
+    (*task.body)(task.begin, task.end, task.chunk);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+}
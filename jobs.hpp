@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Класс JobSystem - небольшой пул потоков для параллельных циклов.
+//
+// ParallelFor делит диапазон [0, count) на куски и раздаёт их очередям
+// потоков. Каждый поток сначала берёт куски из своей очереди, а когда она
+// пустеет, забирает (крадёт) куски из очередей других потоков, так что
+// неравномерная работа всё равно распределяется по всем ядрам. Поток,
+// вызвавший ParallelFor, тоже выполняет куски, пока весь цикл не закончится.
+//
+// Разбиение на куски зависит только от count, но не от числа потоков,
+// поэтому номер куска, в котором оказался элемент, один и тот же при любом
+// числе потоков. Это позволяет собирать результаты кусков в порядке их
+// номеров и получать тот же результат, что и у обычного цикла.
+class JobSystem {
+public:
+    // Число элементов в одном куске.
+    static const size_t GRAIN = 64;
+
+    // Создаёт пул с workers дополнительными потоками. При workers = 0 все
+    // куски выполняет вызывающий поток.
+    explicit JobSystem(int workers);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // Число потоков, которые выполняют куски, включая вызывающий.
+    int ThreadCount() const {
+        return int(queues.size());
+    }
+
+    // Число кусков, на которые ParallelFor разобьёт count элементов.
+    static size_t ChunkCount(size_t count) {
+        return (count + GRAIN - 1) / GRAIN;
+    }
+
+    // Вызывает body(begin, end, chunk) для каждого куска [begin, end)
+    // диапазона [0, count), где chunk - номер куска. Куски выполняются
+    // параллельно и в произвольном порядке. Функция возвращается, когда все
+    // куски выполнены.
+    void ParallelFor(
+        size_t count,
+        const std::function<void(size_t begin, size_t end, size_t chunk)>
+            &body
+    );
+
+private:
+    struct Task {
+        const std::function<void(size_t, size_t, size_t)> *body;
+        size_t begin, end, chunk;
+        std::atomic<size_t> *remaining;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Очередь 0 принадлежит вызывающему потоку, остальные - рабочим.
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{0};
+    bool stopping = false;
+
+    void WorkerLoop(size_t self);
+    // Берёт задачу из своей очереди или крадёт из чужой.
+    bool TryPop(size_t self, Task &task);
+    void Run(const Task &task);
+};
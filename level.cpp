@@ -0,0 +1,353 @@
+#include "level.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// windows.h объявляет функции с теми же именами, что и raylib (CloseWindow,
+// DrawText и другие), поэтому этот файл не подключает raylib.
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Текстуры, которые получает уровень из текстового файла.
+static const char *const DEFAULT_TEXTURES[] = {
+    "Assets/background.png",
+    "Assets/wall1.png",
+    "Assets/wall2.png",
+    "Assets/wall3.png",
+};
+
+static uint32_t AlignUp(size_t offset) {
+    return uint32_t((offset + 3) & ~size_t(3));
+}
+
+LevelView LevelData::View() const {
+    LevelView view;
+    view.width = width;
+    view.height = height;
+    view.cell_size = LEVEL_CELL_SIZE;
+    view.textures = textures;
+    view.tiles = tiles.data();
+    view.spawns = spawns.data();
+    view.spawn_count = spawns.size();
+    return view;
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string &path) {
+    Close();
+    HANDLE handle = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file = handle;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(handle, &file_size) || file_size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    mapping
+        = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        Close();
+        return false;
+    }
+    bytes = static_cast<const uint8_t *>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)
+    );
+    if (!bytes) {
+        Close();
+        return false;
+    }
+    length = size_t(file_size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (bytes) {
+        UnmapViewOfFile(bytes);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    bytes = nullptr;
+    length = 0;
+    mapping = nullptr;
+    file = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::string &path) {
+    Close();
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        Close();
+        return false;
+    }
+    void *view
+        = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    bytes = static_cast<const uint8_t *>(view);
+    length = size_t(info.st_size);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (bytes) {
+        munmap(const_cast<uint8_t *>(bytes), length);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    bytes = nullptr;
+    length = 0;
+    fd = -1;
+}
+
+#endif
+
+void ParseTextLevel(const std::string &text, LevelData &out) {
+    // Строки файла идут сверху вниз, а в уровне строка 0 - нижняя.
+    std::vector<std::pair<size_t, size_t>> lines;
+    for (size_t j = 0; j < text.size(); ++j) {
+        size_t begin = j;
+        while (j < text.size() && text[j] != '\n') {
+            j += 1;
+        }
+        lines.push_back({begin, j - begin});
+    }
+    std::reverse(lines.begin(), lines.end());
+
+    out.height = int(lines.size());
+    out.width = 0;
+    for (const auto &line : lines) {
+        out.width = std::max(out.width, int(line.second));
+    }
+    out.textures.assign(
+        std::begin(DEFAULT_TEXTURES), std::end(DEFAULT_TEXTURES)
+    );
+    out.tiles.assign(size_t(out.width) * out.height, 0);
+    out.spawns.clear();
+
+    bool unknown = false;
+    for (int row = 0; row < out.height; ++row) {
+        const char *line = text.data() + lines[row].first;
+        for (int col = 0; col < int(lines[row].second); ++col) {
+            uint8_t &tile = out.tiles[size_t(row) * out.width + col];
+            switch (line[col]) {
+            case '+':
+                tile = 1;
+                break;
+            case '=':
+                tile = 2;
+                break;
+            case '*':
+                tile = 3;
+                break;
+            case 'p':
+            case '1':
+            case 'f': {
+                LevelSpawn spawn = {};
+                spawn.kind = line[col];
+                spawn.col = col;
+                spawn.row = row;
+                out.spawns.push_back(spawn);
+            } break;
+            case ' ':
+                break;
+            default:
+                unknown = true;
+                break;
+            }
+        }
+    }
+    if (unknown) {
+        std::cerr << "Неизвестный тип объекта" << std::endl;
+    }
+}
+
+bool OpenCompiledLevel(
+    const MappedFile &file,
+    LevelView &out,
+    std::string &error
+) {
+    const uint8_t *data = file.data();
+    size_t size = file.size();
+    if (size < sizeof(LevelHeader)
+        || std::memcmp(data, LEVEL_MAGIC, sizeof(LEVEL_MAGIC)) != 0) {
+        error = "файл не является скомпилированным уровнем";
+        return false;
+    }
+    LevelHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version != LEVEL_VERSION) {
+        error = "неподдерживаемая версия формата "
+                + std::to_string(header.version);
+        return false;
+    }
+
+    // Части не должны выходить за конец файла, а таблицы должны быть
+    // выровнены, чтобы к ним можно было обращаться напрямую.
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t item) {
+        return offset % 4 == 0 && offset + count * item <= size;
+    };
+    uint64_t cells = uint64_t(header.width) * header.height;
+    uint32_t textures = header.texture_count;
+    uint32_t spawns = header.spawn_count;
+    if (!fits(header.textures_offset, textures, sizeof(LevelTexture))
+        || !fits(header.tiles_offset, cells, 1)
+        || !fits(header.spawns_offset, spawns, sizeof(LevelSpawn))
+        || textures < 1 + LEVEL_WALL_KINDS
+        || header.width > INT32_MAX || header.height > INT32_MAX
+        || !(header.cell_size > 0) || !std::isfinite(header.cell_size)) {
+        error = "файл уровня повреждён";
+        return false;
+    }
+    // Вид стены служит номером её текстуры, поэтому больших значений в
+    // сетке быть не может.
+    const uint8_t *tiles = data + header.tiles_offset;
+    for (uint64_t i = 0; i < cells; ++i) {
+        if (tiles[i] > LEVEL_WALL_KINDS) {
+            error = "файл уровня повреждён";
+            return false;
+        }
+    }
+    // Других объектов ParseTextLevel не создаёт.
+    const LevelSpawn *spawn_table
+        = reinterpret_cast<const LevelSpawn *>(data + header.spawns_offset);
+    for (uint32_t i = 0; i < spawns; ++i) {
+        char kind = spawn_table[i].kind;
+        if (kind != 'p' && kind != '1' && kind != 'f') {
+            error = "файл уровня повреждён";
+            return false;
+        }
+    }
+
+    const LevelTexture *table = reinterpret_cast<const LevelTexture *>(
+        data + header.textures_offset
+    );
+    out.textures.clear();
+    for (uint32_t i = 0; i < textures; ++i) {
+        const char *path = table[i].path;
+        out.textures.emplace_back(path, strnlen(path, sizeof(table[i].path)));
+    }
+    out.width = int(header.width);
+    out.height = int(header.height);
+    out.cell_size = header.cell_size;
+    out.tiles = tiles;
+    out.spawns = spawn_table;
+    out.spawn_count = spawns;
+    return true;
+}
+
+bool IsCompiledLevel(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(LEVEL_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    return file && std::memcmp(magic, LEVEL_MAGIC, sizeof(magic)) == 0;
+}
+
+bool CompileLevel(
+    const std::string &lvl_path,
+    const std::string &out_path,
+    std::string &error
+) {
+    std::ifstream in(lvl_path, std::ios::binary);
+    if (!in) {
+        error = "не удалось открыть " + lvl_path;
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    LevelData level;
+    ParseTextLevel(ss.str(), level);
+
+    LevelHeader header = {};
+    std::memcpy(header.magic, LEVEL_MAGIC, sizeof(LEVEL_MAGIC));
+    header.version = LEVEL_VERSION;
+    header.width = uint32_t(level.width);
+    header.height = uint32_t(level.height);
+    header.cell_size = LEVEL_CELL_SIZE;
+    header.texture_count = uint32_t(level.textures.size());
+    header.textures_offset = AlignUp(sizeof(LevelHeader));
+    header.tiles_offset = AlignUp(
+        header.textures_offset + level.textures.size() * sizeof(LevelTexture)
+    );
+    header.spawn_count = uint32_t(level.spawns.size());
+    header.spawns_offset = AlignUp(header.tiles_offset + level.tiles.size());
+    size_t total
+        = header.spawns_offset + level.spawns.size() * sizeof(LevelSpawn);
+
+    std::vector<uint8_t> bytes(total, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    for (size_t i = 0; i < level.textures.size(); ++i) {
+        LevelTexture texture = {};
+        if (level.textures[i].size() >= sizeof(texture.path)) {
+            error = "слишком длинный путь к текстуре " + level.textures[i];
+            return false;
+        }
+        std::memcpy(
+            texture.path, level.textures[i].data(), level.textures[i].size()
+        );
+        std::memcpy(
+            bytes.data() + header.textures_offset + i * sizeof(texture),
+            &texture,
+            sizeof(texture)
+        );
+    }
+    std::copy(
+        level.tiles.begin(),
+        level.tiles.end(),
+        bytes.begin() + header.tiles_offset
+    );
+    if (!level.spawns.empty()) {
+        std::memcpy(
+            bytes.data() + header.spawns_offset,
+            level.spawns.data(),
+            level.spawns.size() * sizeof(LevelSpawn)
+        );
+    }
+
+    std::ofstream out(out_path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    if (!out) {
+        error = "не удалось записать " + out_path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Скомпилированный (бинарный) формат уровня, обычно с расширением .lvlb.
+//
+// Текстовый уровень (.lvl) при каждом запуске приходится разбирать по одному
+// символу. Скомпилированный уровень уже содержит готовую сетку стен и список
+// объектов, поэтому файл достаточно отобразить в память (MappedFile) и
+// скопировать сетку в TileMap целиком, а объекты создать по списку.
+//
+// Файл состоит из частей, которые идут друг за другом:
+//   LevelHeader                      заголовок
+//   LevelTexture[texture_count]      таблица текстур
+//   uint8_t[width * height]          сетка стен, строка 0 - нижняя
+//   LevelSpawn[spawn_count]          объекты в порядке строк, снизу вверх
+// Смещения частей записаны в заголовке и выровнены на 4 байта. Все числа
+// хранятся в порядке байтов little-endian, как на x86 и ARM.
+//
+// Первая текстура таблицы - фон уровня, следующие LEVEL_WALL_KINDS - текстуры
+// стен, textures[kind] для стены вида kind в сетке.
+
+// Первые байты любого скомпилированного уровня.
+const char LEVEL_MAGIC[8] = {'M', 'I', 'T', 'L', 'V', 'L', '\0', '\0'};
+// Увеличивается при каждом несовместимом изменении формата.
+const uint32_t LEVEL_VERSION = 1;
+// Число видов стен: '+', '=' и '*' в текстовом уровне.
+const int LEVEL_WALL_KINDS = 3;
+// Размер клетки уровня в метрах.
+const float LEVEL_CELL_SIZE = 1.6f;
+
+struct LevelHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height;
+    float cell_size;
+    uint32_t texture_count;
+    uint32_t textures_offset;
+    uint32_t tiles_offset;
+    uint32_t spawn_count;
+    uint32_t spawns_offset;
+};
+
+struct LevelTexture {
+    // Путь к картинке, дополненный нулями.
+    char path[64];
+};
+
+// Объект уровня: kind - символ объекта в текстовом уровне ('p', '1', 'f').
+struct LevelSpawn {
+    char kind;
+    uint8_t padding[3];
+    int32_t col, row;
+};
+
+// Уровень, который можно передать в BuildScene. Указатели смотрят либо в
+// отображённый в память файл, либо в LevelData.
+struct LevelView {
+    int width, height;
+    float cell_size;
+    std::vector<std::string> textures;
+    const uint8_t *tiles;
+    const LevelSpawn *spawns;
+    size_t spawn_count;
+};
+
+// Уровень, разобранный из текстового файла.
+struct LevelData {
+    int width = 0, height = 0;
+    std::vector<std::string> textures;
+    std::vector<uint8_t> tiles;
+    std::vector<LevelSpawn> spawns;
+
+    LevelView View() const;
+};
+
+// Класс MappedFile отображает файл в память только для чтения. Страницы
+// файла подгружаются операционной системой при первом обращении к ним, так
+// что открытие даже очень большого файла ничего не читает с диска. На
+// Windows используется CreateFileMapping, на остальных системах - mmap.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Возвращает false, если файл не удалось открыть или он пустой.
+    bool Open(const std::string &path);
+    void Close();
+
+    const uint8_t *data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    void *file = nullptr;
+    void *mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Разбирает текстовый уровень. Неизвестные символы пропускаются с
+// предупреждением, как и раньше в ReadScene.
+void ParseTextLevel(const std::string &text, LevelData &out);
+
+// Проверяет заголовок, границы частей и значения сетки скомпилированного
+// уровня в file и заполняет out указателями на них. При ошибке возвращает false и пишет
+// причину в error.
+bool OpenCompiledLevel(
+    const MappedFile &file,
+    LevelView &out,
+    std::string &error
+);
+
+// Возвращает true, если файл начинается с LEVEL_MAGIC.
+bool IsCompiledLevel(const std::string &path);
+
+// Переводит текстовый уровень lvl_path в скомпилированный out_path. При
+// ошибке возвращает false и пишет причину в error.
+bool CompileLevel(
+    const std::string &lvl_path,
+    const std::string &out_path,
+    std::string &error
+);
@@ -0,0 +1,29 @@
+// Компилятор уровней: переводит текстовый уровень (.lvl) в скомпилированный
+// формат (.lvlb), который игра загружает без разбора по символам. Формат
+// описан в level.hpp.
+//
+// Использование:
+//   mit-game-lvlc <уровень.lvl> <уровень.lvlb>
+//
+// ReadScene сама определяет формат файла по первым байтам, поэтому вместо
+// Assets/game.lvl можно передать скомпилированный уровень.
+
+#include "level.hpp"
+
+#include <cstdio>
+#include <string>
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::fprintf(
+            stderr, "Использование: %s <in.lvl> <out.lvlb>\n", argv[0]
+        );
+        return 1;
+    }
+    std::string error;
+    if (!CompileLevel(argv[1], argv[2], error)) {
+        std::fprintf(stderr, "Ошибка: %s\n", error.c_str());
+        return 1;
+    }
+    return 0;
+}
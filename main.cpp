@@ -9,6 +9,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <thread>
 
 int main() {
     Vector2 screen_size = {800, 600};
@@ -17,97 +18,128 @@ int main() {
 
     Context ctx;
     ctx.camera_pos = {0, 0};
+    ctx.prev_camera_pos = {0, 0};
+    ctx.physics_hz = 120;
+    // Один поток уже есть - это основной поток игры.
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores > 1) {
+        ctx.jobs = std::make_unique<JobSystem>(int(cores) - 1);
+    }
     ctx.time = 0;
     ctx.screen_size = screen_size;
     ctx.state = GameState::MAIN_MENU;
-    ctx.textures_storage = std::map<TextureHash, Texture>();
+    ctx.textures.stats = &ctx.frame_stats;
+    // Картинки декодируются в фоновых потоках, а в видеопамять их загружает
+    // ctx.textures.Poll в начале каждого кадра.
+    ctx.textures.loader
+        = std::make_unique<TextureLoader>(std::max(int(cores) - 1, 1));
+    ctx.show_debug = false;
     Render heart_render = Render(ctx, "Assets/heart.png", Vector2{30.0, 30.0});
     ctx.heart = std::make_unique<Render>(std::move(heart_render));
 
-    std::map<std::string, std::vector<Object>> scenes;
+    std::map<std::string, Scene> scenes;
 
-    ReadScene(ctx, scenes["game"], "Assets/game.lvl");
-    Object obj = Object();
-    obj.gui_draw = DrawStatus;
-    scenes["game"].push_back(std::move(obj));
+    // Меню создаётся первым, чтобы его картинки загрузились раньше картинок
+    // уровня: меню показывается сразу, а уровень догружается, пока игрок
+    // смотрит на меню.
     ConstructMenuScene(ctx, scenes["menu"]);
-    obj = Object();
+    Object obj = Object();
     obj.gui_draw = DrawMainScreen;
     scenes["menu"].push_back(std::move(obj));
+    ReadScene(ctx, scenes["game"], "Assets/game.lvl");
+    obj = Object();
+    obj.gui_draw = DrawStatus;
+    scenes["game"].push_back(std::move(obj));
+    ctx.textures.BuildAtlas();
 
     InitAudioDevice();
-
-    ctx.scenes = scenes;
-
-    ctx.current_scene = scenes["menu"];
+    ctx.shot_sound = ctx.sounds.Load("Assets/Sounds/shot.mp3", 6);
+    ctx.death_sound = ctx.sounds.Load("Assets/Sounds/death.mp3", 1);
+    ctx.enemy_death_sound
+        = ctx.sounds.Load("Assets/Sounds/enemy_death.mp3", 4);
+
+    ctx.scenes = std::move(scenes);
+
+    ctx.current_scene.ResetFrom(ctx.scenes["menu"]);
+    // Симуляция идёт шагами постоянной длины step, а не длиной кадра: так
+    // один долгий кадр не даст игроку пролететь сквозь стену, а результат
+    // симуляции не зависит от частоты кадров. В accumulator копится время,
+    // которое ещё не просимулировано.
+    const float step = 1.0f / float(ctx.physics_hz);
+    // Если кадр шёл слишком долго, лучше замедлить игру, чем пытаться
+    // догнать время всё большим числом шагов.
+    const float max_frame_time = 0.25f;
+    float accumulator = 0;
     while (!WindowShouldClose()) {
         float dt = GetFrameTime();
         ctx.time += uint64_t(dt * 1000);
+        ctx.last_frame_stats = ctx.frame_stats;
+        ctx.frame_stats = FrameStats();
+        ctx.sounds.BeginFrame();
+        ctx.textures.Poll();
+        if (IsKeyPressed(KEY_F3)) {
+            ctx.show_debug = !ctx.show_debug;
+        }
 
         UpdateGameState(ctx);
 
+        if (ctx.state == GameState::MAIN_MENU) {
+            accumulator = 0;
+        } else {
+            accumulator += std::min(dt, max_frame_time);
+            while (accumulator >= step) {
+                StepGame(ctx, step);
+                accumulator -= step;
+            }
+        }
+
+        // Доля шага, которая прошла после последнего шага симуляции. Объекты
+        // и камера рисуются на этой доле пути от прошлого положения к
+        // текущему.
+        float alpha = accumulator / step;
+        Vector2 camera_pos = ctx.camera_pos;
+        ctx.camera_pos = Vector2Lerp(ctx.prev_camera_pos, camera_pos, alpha);
+
         BeginDrawing();
         {
             ClearBackground(BLACK);
 
-            for (auto &obj : ctx.current_scene) {
-                if (obj.gui_draw) {
-                    obj.gui_draw(ctx);
+            // Для отрисовки нужны только позиции, Render и gui_draw, поэтому
+            // проходим только по этим массивам компонентов сцены.
+            Scene &scene = ctx.current_scene;
+            for (size_t i = 0; i < scene.size(); ++i) {
+                if (scene.gui_draws[i]) {
+                    scene.gui_draws[i](ctx);
+                }
+                const Render &render = scene.renders[i];
+                if (!render.visible) {
+                    continue;
                 }
-                if (obj.render.visible) {
-                    Vector2 pos = local_to_screen(&ctx, obj.position);
-                    Vector2 img_size = {
-                        float(obj.render.width),
-                        float(obj.render.height),
-                    };
-                    pos -= img_size * 0.5f;
-                    Texture texture = ctx.textures_storage[obj.render.hash];
-                    DrawTextureV(texture, pos, WHITE);
+                Vector2 img_size = {
+                    float(render.width),
+                    float(render.height),
+                };
+                Vector2 position = Vector2Lerp(
+                    scene.prev_positions[i], scene.positions[i], alpha
+                );
+                // Объекты, которые не попадают на экран, не рисуем.
+                if (!IsOnScreen(ctx, position, img_size / PIXEL_PER_UNIT)) {
+                    continue;
                 }
+                Vector2 pos = local_to_screen(&ctx, position);
+                pos -= img_size * 0.5f;
+                DrawTextureById(ctx, render.texture, pos);
             }
             UpdateSceneState(ctx);
-        }
-        EndDrawing();
-
-        if (ctx.state == GameState::MAIN_MENU) {
-            continue;
-        }
-
-        Object &player = *find_player(ctx.current_scene);
-
-        PlayerControl(ctx, player, dt);
-
-        for (Object &obj : ctx.current_scene) {
-            ApplyGravity(obj, dt);
-            if (obj.enemy.enabled) {
-                EnemyAI(obj, ctx.current_scene, dt);
-            }
-            if (obj.bullet.enabled) {
-                UpdateBullet(ctx, obj, dt);
+            if (ctx.show_debug) {
+                DrawDebugInfo(ctx);
             }
         }
-
-        FixCollisions(ctx.current_scene, dt);
-        MoveCameraTowards(ctx, player, dt);
-        KillEnemies(ctx);
-
-        for (GameId id_to_destroy : ctx.to_destroy) {
-            ctx.current_scene.erase(
-                std::remove_if(
-                    ctx.current_scene.begin(),
-                    ctx.current_scene.end(),
-                    [id_to_destroy](Object &c) { return c.id == id_to_destroy; }
-                ),
-                ctx.current_scene.end()
-            );
-        }
-        ctx.to_destroy.clear();
-
-        for (Object &obj : ctx.to_spawn) {
-            ctx.current_scene.push_back(std::move(obj));
-        }
-        ctx.to_spawn.clear();
+        EndDrawing();
+        ctx.camera_pos = camera_pos;
     }
+    ctx.sounds.Unload();
+    CloseAudioDevice();
     CloseWindow();
 
     return 0;
@@ -0,0 +1,94 @@
+#include "sound.hpp"
+
+#include <algorithm>
+
+SoundBank::~SoundBank() {
+    Unload();
+}
+
+SoundId SoundBank::Load(const std::string &path, int voices) {
+    auto it = ids.find(path);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    if (!IsAudioDeviceReady()) {
+        return -1;
+    }
+    Wave wave = LoadWave(path.c_str());
+    if (!IsWaveValid(wave)) {
+        return -1;
+    }
+    Entry entry;
+    entry.source = LoadSoundFromWave(wave);
+    UnloadWave(wave);
+    for (int i = 0; i < std::max(voices, 1); ++i) {
+        Voice voice;
+        voice.sound = LoadSoundAlias(entry.source);
+        entry.voices.push_back(voice);
+    }
+
+    SoundId id = SoundId(entries.size());
+    entries.push_back(std::move(entry));
+    ids[path] = id;
+    return id;
+}
+
+void SoundBank::Play(SoundId id, float volume) {
+    if (id < 0 || id >= SoundId(entries.size())) {
+        return;
+    }
+    Entry &entry = entries[id];
+    volume = std::clamp(volume, 0.0f, 1.0f);
+
+    if (entry.last_frame == frame) {
+        Voice &voice = entry.voices[entry.last_voice];
+        if (volume > voice.volume) {
+            voice.volume = volume;
+            SetSoundVolume(voice.sound, volume);
+        }
+        return;
+    }
+
+    // Свободный голос, а если свободных нет - самый тихий и самый старый.
+    size_t best = 0;
+    bool best_free = false;
+    for (size_t i = 0; i < entry.voices.size(); ++i) {
+        const Voice &voice = entry.voices[i];
+        bool free = !IsSoundPlaying(voice.sound);
+        if (free) {
+            best = i;
+            best_free = true;
+            break;
+        }
+        const Voice &current = entry.voices[best];
+        if (voice.volume < current.volume
+            || (voice.volume == current.volume
+                && voice.started < current.started)) {
+            best = i;
+        }
+    }
+    // Украденный голос тише нового звука или так же громок, иначе новый
+    // звук не стоит того, чтобы прерывать старый.
+    if (!best_free && entry.voices[best].volume > volume) {
+        return;
+    }
+
+    Voice &voice = entry.voices[best];
+    voice.volume = volume;
+    voice.started = plays++;
+    SetSoundVolume(voice.sound, volume);
+    PlaySound(voice.sound);
+    entry.last_frame = frame;
+    entry.last_voice = best;
+}
+
+void SoundBank::Unload() {
+    for (Entry &entry : entries) {
+        for (Voice &voice : entry.voices) {
+            UnloadSoundAlias(voice.sound);
+        }
+        UnloadSound(entry.source);
+    }
+    entries.clear();
+    ids.clear();
+}
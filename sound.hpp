@@ -0,0 +1,83 @@
+#pragma once
+
+#include <raylib.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef int SoundId;
+
+// Класс SoundBank хранит все звуковые эффекты игры.
+//
+// LoadSound читает и декодирует файл при каждом вызове, поэтому вызывать её
+// на каждый выстрел слишком дорого. SoundBank декодирует каждый звук один раз
+// при запуске игры и выдаёт вместо него небольшой номер SoundId. Play по
+// номеру только запускает уже готовый звук, не обращаясь к диску.
+//
+// Один объект Sound не может играть сам с собой внахлёст: повторный
+// PlaySound начинает его заново. Поэтому для каждого звука заводится
+// несколько копий (голосов, LoadSoundAlias), которые используют те же данные,
+// что и исходный звук. Так несколько быстрых выстрелов подряд звучат
+// одновременно.
+//
+// Число голосов звука задаётся при загрузке и ограничивает, сколько его
+// экземпляров может звучать одновременно, а значит, и работу микшера в
+// больших сражениях. Если все голоса заняты, Play забирает самый тихий из
+// них, а среди одинаково громких - самый старый. Кроме того, одинаковые
+// звуки, запущенные за один кадр, всё равно слились бы в один, поэтому
+// повторные вызовы Play в том же кадре не занимают новый голос: звучит один
+// экземпляр с наибольшей из запрошенных громкостей.
+class SoundBank {
+public:
+    // Число голосов звука по умолчанию.
+    static const int VOICES_PER_SOUND = 8;
+
+    SoundBank() = default;
+    ~SoundBank();
+
+    SoundBank(const SoundBank &) = delete;
+    SoundBank &operator=(const SoundBank &) = delete;
+
+    // Загружает и декодирует звук из файла path и возвращает его номер.
+    // Одновременно может звучать не больше voices экземпляров звука. Если
+    // звук уже загружен, возвращает прежний номер. Если аудиоустройство не
+    // инициализировано (например, в headless-режиме) или файл не удалось
+    // прочитать, возвращает -1.
+    SoundId Load(const std::string &path, int voices = VOICES_PER_SOUND);
+
+    // Запускает звук с номером id с громкостью volume от 0 до 1. При
+    // id = -1 ничего не делает.
+    void Play(SoundId id, float volume = 1.0f);
+
+    // Начинает новый кадр. Вызывается один раз в начале каждого кадра, чтобы
+    // Play могла объединять одинаковые звуки одного кадра.
+    void BeginFrame() {
+        frame += 1;
+    }
+
+    // Выгружает все звуки. Нужно вызвать до CloseAudioDevice.
+    void Unload();
+
+private:
+    struct Voice {
+        Sound sound;
+        float volume = 0;
+        // Порядковый номер запуска: чем меньше, тем старше голос.
+        uint64_t started = 0;
+    };
+
+    struct Entry {
+        Sound source;
+        std::vector<Voice> voices;
+        // Кадр и голос последнего запуска звука.
+        uint64_t last_frame = 0;
+        size_t last_voice = 0;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t frame = 1;
+    uint64_t plays = 0;
+    std::unordered_map<std::string, SoundId> ids;
+};
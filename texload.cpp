@@ -0,0 +1,115 @@
+#include "texload.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+using Clock = std::chrono::steady_clock;
+
+static double MillisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+}
+
+TextureLoader::TextureLoader(int threads_count) {
+    for (int i = 0; i < std::max(threads_count, 1); ++i) {
+        threads.emplace_back(&TextureLoader::WorkerLoop, this);
+    }
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (LoadedImage &loaded : done) {
+        UnloadImage(loaded.image);
+    }
+}
+
+void TextureLoader::Push(TextureJob job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+        pending += 1;
+    }
+    wake.notify_one();
+}
+
+bool TextureLoader::Pop(LoadedImage &out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (done.empty()) {
+        return false;
+    }
+    out = done.front();
+    done.pop_front();
+    pending -= 1;
+    return true;
+}
+
+size_t TextureLoader::Pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+void TextureLoader::WorkerLoop() {
+    while (true) {
+        TextureJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        LoadedImage loaded;
+        loaded.id = job.id;
+        auto decode_start = Clock::now();
+        loaded.image = LoadImage(job.path.c_str());
+        loaded.decode_ms = MillisecondsSince(decode_start);
+
+        auto resize_start = Clock::now();
+        if (job.resize_width > 0 && loaded.image.data) {
+            ImageResize(&loaded.image, job.resize_width, job.resize_height);
+        }
+        if (job.to_rgba8 && loaded.image.data) {
+            ImageFormat(&loaded.image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        }
+        loaded.resize_ms = MillisecondsSince(resize_start);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back(loaded);
+    }
+}
+
+bool ReadImageSize(const std::string &path, int &width, int &height) {
+    // Файл PNG начинается с 8 байт подписи, за которыми идёт блок IHDR:
+    // 4 байта длины, 4 байта имени, а затем ширина и высота, записанные
+    // старшим байтом вперёд.
+    static const unsigned char signature[8]
+        = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    unsigned char header[24];
+    std::ifstream file(path, std::ios::binary);
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!file || std::memcmp(header, signature, sizeof(signature)) != 0
+        || std::memcmp(header + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+    auto read_u32 = [&header](int offset) {
+        return (uint32_t(header[offset]) << 24)
+               | (uint32_t(header[offset + 1]) << 16)
+               | (uint32_t(header[offset + 2]) << 8)
+               | uint32_t(header[offset + 3]);
+    };
+    width = int(read_u32(16));
+    height = int(read_u32(20));
+    return width > 0 && height > 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <raylib.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Задание на загрузку одной картинки. Картинка читается из path и, если
+// resize_width > 0, растягивается до resize_width на resize_height пикселей.
+// Если to_rgba8 равно true, она ещё и переводится в формат RGBA8, в котором
+// картинки копируются в атлас.
+struct TextureJob {
+    int id;
+    std::string path;
+    int resize_width = 0, resize_height = 0;
+    bool to_rgba8 = false;
+};
+
+// Результат TextureJob: готовая картинка и время каждого этапа.
+struct LoadedImage {
+    int id;
+    Image image;
+    double decode_ms, resize_ms;
+};
+
+// Класс TextureLoader читает и декодирует картинки в фоновых потоках.
+//
+// Чтение файла, декодирование PNG и изменение размера картинки делаются
+// только на процессоре, поэтому их можно выполнять в любом потоке. А вот
+// загрузка текстуры в видеопамять (LoadTextureFromImage) возможна только в
+// потоке, который создал окно. Поэтому потоки загрузчика только готовят
+// картинки, а основной поток забирает их через Pop и загружает сам.
+class TextureLoader {
+public:
+    // Создаёт загрузчик с threads фоновыми потоками (не меньше одного).
+    explicit TextureLoader(int threads);
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    void Push(TextureJob job);
+
+    // Забирает одну готовую картинку. Возвращает false, если готовых
+    // картинок пока нет.
+    bool Pop(LoadedImage &out);
+
+    // Сколько заданий ещё не забрано через Pop, включая выполняемые.
+    size_t Pending();
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<TextureJob> jobs;
+    std::deque<LoadedImage> done;
+    size_t pending = 0;
+    bool stopping = false;
+
+    void WorkerLoop();
+};
+
+// Читает размеры картинки из заголовка PNG-файла, не декодируя её. Для
+// файлов других форматов возвращает false.
+bool ReadImageSize(const std::string &path, int &width, int &height);
@@ -0,0 +1,245 @@
+#include "internal.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Реализация TextureRegistry, кроме сборки атласов (см. atlas.cpp).
+
+TextureKey TextureRegistry::MakeKey(
+    const std::string &path,
+    TextureResize resize,
+    float width,
+    float height
+) {
+    auto it = path_ids.find(path);
+    uint32_t path_id;
+    if (it != path_ids.end()) {
+        path_id = it->second;
+    } else {
+        path_id = uint32_t(paths.size());
+        paths.push_back(path);
+        path_hashes.push_back(HashBytes(path.data(), path.size()));
+        path_ids.emplace(path, path_id);
+    }
+
+    TextureKey key;
+    key.path = path_id;
+    key.resize = resize;
+    key.width = width;
+    key.height = height;
+    uint32_t width_bits, height_bits;
+    std::memcpy(&width_bits, &width, sizeof(width_bits));
+    std::memcpy(&height_bits, &height, sizeof(height_bits));
+    uint64_t params = (uint64_t(width_bits) << 32) | height_bits;
+    key.hash = HashCombine(
+        HashCombine(path_hashes[path_id], uint64_t(resize)), params
+    );
+    return key;
+}
+
+void TextureRegistry::ReportCollision(
+    const TextureKey &existing,
+    const TextureKey &added
+) {
+    std::cerr << "Совпали хеши двух разных текстур: " << paths[existing.path]
+              << " (" << existing.width << "x" << existing.height << ") и "
+              << paths[added.path] << " (" << added.width << "x"
+              << added.height << ")" << std::endl;
+    std::abort();
+}
+
+// Размер картинки width на height после изменения, описанного в key.
+static void ResizedSize(const TextureKey &key, int &width, int &height) {
+    if (key.resize == TextureResize::SCALE) {
+        width = int(width * key.width);
+        height = int(height * key.width);
+    } else if (key.resize == TextureResize::SIZE) {
+        width = int(key.width);
+        height = int(key.height);
+    }
+}
+
+TextureId TextureRegistry::Load(const TextureKey &key) {
+    TextureId id = Find(key);
+    if (id >= 0) {
+        return id;
+    }
+    const std::string &path = paths[key.path];
+    if (headless && key.resize == TextureResize::SIZE) {
+        return AddBlank(key, int(key.width), int(key.height));
+    }
+
+    int width, height;
+    if (loader && !headless && ReadImageSize(path, width, height)) {
+        ResizedSize(key, width, height);
+        return AddAsync(key, width, height);
+    }
+
+    // Без загрузчика (или если размер картинки не узнать заранее) картинка
+    // загружается прямо здесь.
+    TextureTiming timing = {key.path, 0, 0, 0};
+    double start = GetTime();
+    Image image = LoadImage(path.c_str());
+    timing.decode_ms = (GetTime() - start) * 1000;
+    start = GetTime();
+    width = image.width;
+    height = image.height;
+    ResizedSize(key, width, height);
+    if (key.resize != TextureResize::NONE) {
+        ImageResize(&image, width, height);
+    }
+    timing.resize_ms = (GetTime() - start) * 1000;
+    start = GetTime();
+    id = Add(key, image);
+    timing.upload_ms = (GetTime() - start) * 1000;
+    if (!headless) {
+        timings.push_back(timing);
+    }
+    return id;
+}
+
+TextureId TextureRegistry::AddAsync(
+    const TextureKey &key,
+    int width,
+    int height
+) {
+    TextureId id = TextureId(entries.size());
+    TextureEntry entry;
+    entry.texture = Texture{};
+    entry.source = Rectangle{0, 0, float(width), float(height)};
+    entries.push_back(entry);
+    keys.push_back(key);
+    ids[key.hash] = id;
+    if (!atlas_built) {
+        pending_images.push_back(Image{});
+    }
+
+    TextureJob job;
+    job.id = id;
+    job.path = paths[key.path];
+    if (key.resize != TextureResize::NONE) {
+        job.resize_width = width;
+        job.resize_height = height;
+    }
+    job.to_rgba8 = !atlas_built && width <= ATLAS_MAX_ITEM_SIZE
+                   && height <= ATLAS_MAX_ITEM_SIZE;
+    loader->Push(std::move(job));
+    return id;
+}
+
+void TextureRegistry::Poll() {
+    if (!loader) {
+        return;
+    }
+    LoadedImage loaded;
+    while (loader->Pop(loaded)) {
+        TextureTiming timing = {
+            keys[loaded.id].path, loaded.decode_ms, loaded.resize_ms, 0
+        };
+        if (loaded.image.data == nullptr) {
+            timings.push_back(timing);
+            continue;
+        }
+        double start = GetTime();
+        TextureEntry &entry = entries[loaded.id];
+        entry.texture = LoadTextureFromImage(loaded.image);
+        timing.upload_ms = (GetTime() - start) * 1000;
+        timings.push_back(timing);
+
+        bool fits = loaded.image.width <= ATLAS_MAX_ITEM_SIZE
+                    && loaded.image.height <= ATLAS_MAX_ITEM_SIZE;
+        if (!atlas_built && fits) {
+            ImageFormat(&loaded.image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+            pending_images[loaded.id] = loaded.image;
+        } else {
+            UnloadImage(loaded.image);
+        }
+    }
+
+    if (loader->Pending() > 0) {
+        return;
+    }
+    if (atlas_requested && !atlas_built) {
+        BuildAtlas();
+    }
+    if (reported < timings.size()) {
+        PrintTimings();
+    }
+}
+
+void TextureRegistry::PrintTimings() {
+    TextureTiming total = {0, 0, 0, 0};
+    for (size_t i = reported; i < timings.size(); ++i) {
+        const TextureTiming &timing = timings[i];
+        TraceLog(
+            LOG_INFO,
+            "TEXLOAD: %-32s decode %7.2f ms, resize %7.2f ms, upload %7.2f ms",
+            paths[timing.path].c_str(),
+            timing.decode_ms,
+            timing.resize_ms,
+            timing.upload_ms
+        );
+        total.decode_ms += timing.decode_ms;
+        total.resize_ms += timing.resize_ms;
+        total.upload_ms += timing.upload_ms;
+    }
+    TraceLog(
+        LOG_INFO,
+        "TEXLOAD: %d textures: decode %.2f ms, resize %.2f ms, upload %.2f ms;"
+        " all loaded %.2f ms after start",
+        int(timings.size() - reported),
+        total.decode_ms,
+        total.resize_ms,
+        total.upload_ms,
+        GetTime() * 1000
+    );
+    reported = timings.size();
+}
+
+TextureId TextureRegistry::Add(const TextureKey &key, Image image) {
+    if (headless) {
+        TextureId id = AddBlank(key, image.width, image.height);
+        UnloadImage(image);
+        return id;
+    }
+
+    TextureId id = TextureId(entries.size());
+    TextureEntry entry;
+    entry.texture = LoadTextureFromImage(image);
+    entry.source = Rectangle{0, 0, float(image.width), float(image.height)};
+    entries.push_back(entry);
+    keys.push_back(key);
+    ids[key.hash] = id;
+
+    bool fits = image.width <= ATLAS_MAX_ITEM_SIZE
+                && image.height <= ATLAS_MAX_ITEM_SIZE;
+    if (atlas_built) {
+        UnloadImage(image);
+    } else if (fits) {
+        ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        pending_images.push_back(image);
+    } else {
+        UnloadImage(image);
+        pending_images.push_back(Image{});
+    }
+    return id;
+}
+
+TextureId TextureRegistry::AddBlank(
+    const TextureKey &key,
+    int width,
+    int height
+) {
+    TextureId id = TextureId(entries.size());
+    TextureEntry entry;
+    entry.texture = Texture{};
+    entry.source = Rectangle{0, 0, float(width), float(height)};
+    entries.push_back(entry);
+    keys.push_back(key);
+    ids[key.hash] = id;
+    if (!atlas_built) {
+        pending_images.push_back(Image{});
+    }
+    return id;
+}
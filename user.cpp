@@ -1,9 +1,17 @@
 #include "user.hpp"
 #include "internal.hpp"
+#include "grid.hpp"
+#include "collide.hpp"
 
 #include <raymath.h>
 #include <raylib.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
 // Задание CheckCollision.
 //
 // Эта функция выполняет проверку на столкновение двух объектов (obj1 и obj2).
@@ -22,7 +30,7 @@
 // Возможное решение может занимать примерно 15-18 строк.
 // Ваше решение может сильно отличаться.
 //
-Collision CheckCollision(Object &obj1, Object &obj2) {
+Collision CheckCollision(ObjectRef obj1, ObjectRef obj2) {
     Vector2 d = obj2.position - obj1.position;
     Vector2 q = {
         abs(d.x) - (obj1.collider.width + obj2.collider.width) / 2,
@@ -36,6 +44,87 @@ Collision CheckCollision(Object &obj1, Object &obj2) {
     Collision{false, {0, 0}};
 }
 
+// То же самое, что CheckCollision для двух объектов, только вторым
+// участником столкновения выступает прямоугольник из стен TileMap.
+Collision CheckCollision(ObjectRef obj, const TileRect &rect) {
+    Vector2 d = rect.position - obj.position;
+    Vector2 q = {
+        std::abs(d.x) - (obj.collider.width + rect.width) / 2,
+        std::abs(d.y) - (obj.collider.height + rect.height) / 2,
+    };
+    if (q.x >= 0 || q.y >= 0) {
+        return Collision{false, {0, 0}};
+    }
+    return Collision{
+        true,
+        {
+            d.x < 0 ? -std::abs(q.x) : std::abs(q.x),
+            d.y < 0 ? -std::abs(q.y) : std::abs(q.y),
+        },
+    };
+}
+
+// CheckCollision проверяет объекты только в их конечных положениях. Если за
+// один шаг объект сдвигается больше, чем на половину своего размера, он может
+// проскочить тонкую стену целиком, так и не пересёкшись с ней. Для таких
+// объектов используется SweepCollision: она проверяет весь путь объекта с
+// размерами size из точки position в точку position + motion и находит
+// момент, когда он впервые коснётся неподвижного прямоугольника с центром
+// other_position и размерами other_size.
+//
+// Прямоугольник other расширяется на половину размеров объекта, после чего
+// задача сводится к пересечению отрезка пути центра объекта с расширенным
+// прямоугольником. Если объект уже пересекается с other в начале пути,
+// столкновение не возвращается: его решит обычная SolveCollision.
+SweptCollision SweepCollision(
+    Vector2 position,
+    Vector2 size,
+    Vector2 motion,
+    Vector2 other_position,
+    Vector2 other_size
+) {
+    const SweptCollision none = {false, 0, {0, 0}};
+    Vector2 half = (size + other_size) * 0.5f;
+    Vector2 d = other_position - position;
+
+    // Для каждой оси находим моменты входа в полосу other и выхода из неё.
+    float entry[2], exit[2];
+    const float ds[2] = {d.x, d.y};
+    const float halves[2] = {half.x, half.y};
+    const float moves[2] = {motion.x, motion.y};
+    for (int axis = 0; axis < 2; ++axis) {
+        if (moves[axis] == 0) {
+            if (std::abs(ds[axis]) >= halves[axis]) {
+                return none;
+            }
+            entry[axis] = -INFINITY;
+            exit[axis] = INFINITY;
+            continue;
+        }
+        float t1 = (ds[axis] - halves[axis]) / moves[axis];
+        float t2 = (ds[axis] + halves[axis]) / moves[axis];
+        entry[axis] = std::min(t1, t2);
+        exit[axis] = std::max(t1, t2);
+    }
+
+    float time = std::max(entry[0], entry[1]);
+    if (time > std::min(exit[0], exit[1]) || time < 0 || time > 1) {
+        return none;
+    }
+    if (entry[0] > entry[1]) {
+        return SweptCollision{true, time, {motion.x > 0 ? -1.0f : 1.0f, 0}};
+    }
+    return SweptCollision{true, time, {0, motion.y > 0 ? -1.0f : 1.0f}};
+}
+
+// Возвращает true, если за шаг объект с размерами size сдвигается на motion
+// больше, чем на половину своего размера хотя бы по одной оси. Такой объект
+// может проскочить стену, и его путь нужно проверять через SweepCollision.
+bool IsFastMotion(Vector2 motion, Vector2 size) {
+    return std::abs(motion.x) > size.x * 0.5f
+           || std::abs(motion.y) > size.y * 0.5f;
+}
+
 // Задание SolveCollision.
 //
 // Наше решение коллизий не является идеальным, но будем считать его достаточно
@@ -53,10 +142,150 @@ Collision CheckCollision(Object &obj1, Object &obj2) {
 // коллизия по вертикали положительна (c.overlap.y > 0), то скорость объекта
 // по оси y обнуляется (obj.physics.speed.y = 0).
 //
+// Замечание к решению ниже: CheckCollision возвращает в overlap глубину
+// проникновения по каждой оси, поэтому объект выталкивается вдоль оси с
+// меньшим |overlap|. Так он сдвигается на кратчайшее расстояние, и стоящий
+// на полу объект не выбрасывается вбок.
+//
 // Возможное решение может занимать примерно 14-20 строк.
 // Ваше решение может сильно отличаться.
 //
-void SolveCollision(Object &obj, Collision c, float dt) {}
+void SolveCollision(ObjectRef obj, Collision c, [[maybe_unused]] float dt) {
+    if (!c.exists) {
+        return;
+    }
+
+    // Выталкиваем объект вдоль той оси, по которой перекрытие меньше, иначе
+    // стоящий на полу объект выталкивался бы вбок. overlap направлен в
+    // сторону второго объекта, поэтому двигаемся в противоположную сторону.
+    if (std::abs(c.overlap.x) < std::abs(c.overlap.y)) {
+        obj.position.x -= c.overlap.x;
+        return;
+    }
+
+    obj.position.y -= c.overlap.y;
+    if (c.overlap.y < 0) {
+        if (obj.physics.speed.y < 0) {
+            obj.physics.can_jump = true;
+        }
+        obj.physics.acceleration.y = 0;
+        obj.physics.speed.y = 0;
+    } else if (c.overlap.y > 0) {
+        obj.physics.speed.y = 0;
+    }
+}
+
+// Решает столкновение c, найденное SweepCollision для пути объекта obj,
+// который начался в точке start и закончился в obj.position. Объект
+// останавливается в момент касания, а оставшаяся часть пути сохраняется
+// только вдоль стены, так что объект продолжает скользить по ней. Скорость
+// поперёк стены обнуляется так же, как в SolveCollision.
+void SolveCollision(ObjectRef obj, SweptCollision c, Vector2 start) {
+    if (!c.exists) {
+        return;
+    }
+
+    Vector2 motion = obj.position - start;
+    Vector2 rest = motion * (1 - c.time);
+    rest -= c.normal * Vector2DotProduct(rest, c.normal);
+    obj.position = start + motion * c.time + rest;
+
+    if (c.normal.y > 0) {
+        if (obj.physics.speed.y < 0) {
+            obj.physics.can_jump = true;
+        }
+        obj.physics.acceleration.y = 0;
+        obj.physics.speed.y = 0;
+    } else if (c.normal.y < 0) {
+        obj.physics.speed.y = 0;
+    }
+}
+
+// Находит первую стену из tiles, которой коснётся объект с размерами size,
+// двигаясь из точки start на motion. Как и SweepCollision, не находит стены,
+// с которыми объект пересекается уже в точке start.
+static SweptCollision SweepTiles(
+    const TileMap &tiles,
+    Vector2 start,
+    Vector2 size,
+    Vector2 motion
+) {
+    // UpdateBullet вызывается из нескольких потоков, поэтому у каждого
+    // потока свой список.
+    thread_local std::vector<int> path_rects;
+    Vector2 path_center = start + motion * 0.5f;
+    Vector2 path_size = size + Vector2{std::abs(motion.x), std::abs(motion.y)};
+    tiles.Query(path_center, path_size, path_rects);
+
+    SweptCollision first = {false, 1, {0, 0}};
+    for (int id : path_rects) {
+        const TileRect &rect = tiles.rects[id];
+        SweptCollision c = SweepCollision(
+            start, size, motion, rect.position, {rect.width, rect.height}
+        );
+        if (c.exists && c.time <= first.time) {
+            first = c;
+        }
+    }
+    return first;
+}
+
+// Возвращает true, если объект obj уже пересекается с какой-нибудь стеной
+// из tiles. SweepCollision такие пересечения не находит.
+static bool OverlapsTiles(const TileMap &tiles, ObjectRef obj) {
+    thread_local std::vector<int> rects;
+    Vector2 size = {obj.collider.width, obj.collider.height};
+    tiles.Query(obj.position, size, rects);
+    for (int id : rects) {
+        if (CheckCollision(obj, tiles.rects[id]).exists) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Решает столкновения obj с прямоугольниками batch по порядку, как цикл
+// с CheckCollision и SolveCollision. После каждого решения объект сдвигается,
+// поэтому оставшиеся прямоугольники проверяются заново уже из новой позиции.
+static void SolveBatch(ObjectRef obj, const AabbBatch &batch, float dt) {
+    thread_local std::vector<AabbHit> hits;
+    Vector2 size = {obj.collider.width, obj.collider.height};
+    size_t first = 0;
+    while (first < batch.size()) {
+        CollideBatch(obj.position, size, batch, first, hits);
+        if (hits.empty()) {
+            break;
+        }
+        SolveCollision(obj, Collision{true, hits[0].overlap}, dt);
+        first = hits[0].index + 1;
+    }
+}
+
+// Вызывает body(begin, end) для кусков диапазона [0, count): в потоках jobs,
+// если они есть, или одним куском в текущем потоке.
+static void RunChunks(
+    JobSystem *jobs,
+    size_t count,
+    const std::function<void(size_t begin, size_t end)> &body
+) {
+    if (!jobs) {
+        body(0, count);
+        return;
+    }
+    jobs->ParallelFor(count, [&body](size_t begin, size_t end, size_t) {
+        body(begin, end);
+    });
+}
+
+// Находит корень множества элемента x в системе непересекающихся множеств
+// parent, попутно сокращая путь до корня.
+static size_t FindRoot(std::vector<size_t> &parent, size_t x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
 
 // Задание FixCollisions.
 //
@@ -65,9 +294,9 @@ void SolveCollision(Object &obj, Collision c, float dt) {}
 //
 // Сначала пройдёмся в цикле по всем объектам сцены (scene). Это можно очень
 // удобно сделать сделать с помощью цикла for-each, который появился в С++11:
-// for (Object &obj1 : scene). Для каждого объекта проверим, что он подчиняется
-// физическим законам нашего игрового мира. Для этого у него должен быть
-// коллайдер (obj1.collider.enabled) - это некий прямоугольник, описывающий
+// for (ObjectRef obj1 : scene). Для каждого объекта проверим, что он
+// подчиняется физическим законам нашего игрового мира. Для этого у него должен
+// быть коллайдер (obj1.collider.enabled) - это некий прямоугольник, описывающий
 // физические границы объекта. Кроме того, этот коллайдер должен быть
 // динамическим (ColliderType::DYNAMIC), то есть объект может двигаться сам или
 // под воздействием внешних сил, это можно проверить, используя метод of_type
@@ -92,7 +321,230 @@ void SolveCollision(Object &obj, Collision c, float dt) {}
 // Возможное решение может занимать примерно 14-20 строк.
 // Ваше решение может сильно отличаться.
 //
-void FixCollisions(Scene &scene, float dt) {}
+// Полный перебор пар занимает O(n^2), и на больших уровнях он становится
+// самой медленной частью кадра. Поэтому по умолчанию кандидаты во второй
+// объект берутся из равномерной сетки SpatialGrid: в неё кладутся все
+// подходящие коллайдеры, а для каждого динамического объекта просматриваются
+// только соседние клетки. Полный перебор остаётся доступен через флаг
+// collision_broadphase.
+//
+// Если передан пул потоков jobs, столкновения решаются в нескольких потоках
+// (см. collision_islands), а результат остаётся таким же, как без него.
+//
+// Стены уровня не являются объектами сцены и лежат в scene.tiles. Их
+// прямоугольники находятся по клеткам, которые накрывает объект, и
+// проверяются до столкновений с другими объектами. Если объект за шаг
+// сдвинулся слишком далеко (см. IsFastMotion), то сначала весь его путь от
+// scene.prev_positions проверяется через SweepCollision, чтобы он не
+// проскочил стену.
+//
+void FixCollisions(Scene &scene, float dt, JobSystem *jobs) {
+    auto is_solid = [](ObjectRef obj) {
+        return obj.collider.enabled
+               && (obj.collider.of_type(ColliderType::DYNAMIC)
+                   || obj.collider.of_type(ColliderType::STATIC));
+    };
+    auto is_dynamic = [](ObjectRef obj) {
+        return obj.collider.enabled
+               && obj.collider.of_type(ColliderType::DYNAMIC);
+    };
+
+    // Сетка и списки переиспользуются между кадрами, чтобы не выделять
+    // память заново.
+    static SpatialGrid grid;
+    static std::vector<size_t> candidates;
+    // Слоты динамических объектов по возрастанию.
+    static std::vector<size_t> dynamic;
+    dynamic.clear();
+    for (size_t i = 0; i < scene.size(); ++i) {
+        if (is_dynamic(scene[i])) {
+            dynamic.push_back(i);
+        }
+    }
+
+    // Со стенами каждый объект сталкивается независимо от остальных,
+    // поэтому объекты можно обрабатывать в разных потоках.
+    const TileMap &tiles = *scene.tiles;
+    RunChunks(jobs, dynamic.size(), [&](size_t begin, size_t end) {
+        thread_local std::vector<int> tile_rects;
+        thread_local AabbBatch batch;
+        for (size_t k = begin; k < end; ++k) {
+            size_t i = dynamic[k];
+            ObjectRef obj = scene[i];
+            Vector2 size = {obj.collider.width, obj.collider.height};
+            Vector2 start = scene.prev_positions[i];
+            Vector2 motion = obj.position - start;
+            if (IsFastMotion(motion, size)) {
+                SweptCollision first = SweepTiles(tiles, start, size, motion);
+                SolveCollision(obj, first, start);
+            }
+            tiles.Query(obj.position, size, tile_rects);
+            batch.Clear();
+            for (int id : tile_rects) {
+                const TileRect &rect = tiles.rects[id];
+                batch.Add(rect.position, {rect.width, rect.height});
+            }
+            SolveBatch(obj, batch, dt);
+        }
+    });
+
+    if (!collision_broadphase) {
+        for (ObjectRef obj1 : scene) {
+            if (!is_dynamic(obj1)) {
+                continue;
+            }
+            for (ObjectRef obj2 : scene) {
+                if (obj1 == obj2 || !is_solid(obj2)) {
+                    continue;
+                }
+                SolveCollision(obj1, CheckCollision(obj1, obj2), dt);
+            }
+        }
+        return;
+    }
+
+    float cell_size = 0;
+    for (ObjectRef obj : scene) {
+        if (is_solid(obj)) {
+            cell_size = std::max(
+                cell_size, std::max(obj.collider.width, obj.collider.height)
+            );
+        }
+    }
+    grid.Reset(cell_size);
+    for (size_t i = 0; i < scene.size(); ++i) {
+        ObjectRef obj = scene[i];
+        if (is_solid(obj)) {
+            grid.Insert(
+                i, obj.position, {obj.collider.width, obj.collider.height}
+            );
+        }
+    }
+
+    // Объект при решении своих столкновений двигается сам, но не двигает
+    // других, поэтому кандидатов для всех объектов можно найти заранее.
+    // Кандидаты k-го динамического объекта лежат в candidate_list с номера
+    // candidate_start[k] до candidate_start[k + 1].
+    //
+    // Динамические объекты могут сдвинуться при решении предыдущих коллизий,
+    // поэтому область поиска немного расширяется.
+    static std::vector<size_t> candidate_start;
+    static std::vector<size_t> candidate_list;
+    candidate_start.clear();
+    candidate_list.clear();
+    const float margin = grid.cell_size * 0.5f;
+    for (size_t i : dynamic) {
+        ObjectRef obj = scene[i];
+        Vector2 area = {
+            obj.collider.width + margin * 2,
+            obj.collider.height + margin * 2,
+        };
+        grid.Query(obj.position, area, candidates);
+        candidate_start.push_back(candidate_list.size());
+        for (size_t j : candidates) {
+            if (j != i) {
+                candidate_list.push_back(j);
+            }
+        }
+    }
+    candidate_start.push_back(candidate_list.size());
+
+    auto solve_object = [&](size_t k) {
+        thread_local AabbBatch batch;
+        batch.Clear();
+        for (size_t c = candidate_start[k]; c < candidate_start[k + 1]; ++c) {
+            size_t j = candidate_list[c];
+            const Collider &collider = scene.colliders[j];
+            batch.Add(scene.positions[j], {collider.width, collider.height});
+        }
+        SolveBatch(scene[dynamic[k]], batch, dt);
+    };
+
+    auto solve_serial = [&]() {
+        for (size_t k = 0; k < dynamic.size(); ++k) {
+            solve_object(k);
+        }
+    };
+
+    // Разбиение на острова само стоит O(n) на каждый шаг, и окупается оно
+    // только тогда, когда острова действительно решаются одновременно.
+    // Если ядро одно, потоки всё равно выполнялись бы по очереди, а если
+    // объектов не больше одного куска JobSystem, все острова попали бы в
+    // один кусок и решались бы в одном потоке. collision_islands_forced
+    // отключает эти проверки, чтобы острова можно было проверить где угодно.
+    static const bool multicore = std::thread::hardware_concurrency() > 1;
+    const bool worthwhile = multicore && jobs && jobs->ThreadCount() >= 2
+                            && dynamic.size() > JobSystem::GRAIN;
+    if (!jobs || !collision_islands
+        || (!worthwhile && !collision_islands_forced)) {
+        solve_serial();
+        return;
+    }
+
+    // Делим динамические объекты на острова: два объекта попадают в один
+    // остров, если один из них - кандидат другого. Объекты разных островов
+    // никак не влияют друг на друга, поэтому острова решаются в разных
+    // потоках. Внутри острова объекты решаются в том же порядке, что и в
+    // обычном цикле, так что результат не отличается от него.
+    static std::vector<size_t> dynamic_index;
+    static std::vector<size_t> parent;
+    dynamic_index.assign(scene.size(), SIZE_MAX);
+    parent.resize(dynamic.size());
+    for (size_t k = 0; k < dynamic.size(); ++k) {
+        dynamic_index[dynamic[k]] = k;
+        parent[k] = k;
+    }
+    for (size_t k = 0; k < dynamic.size(); ++k) {
+        for (size_t c = candidate_start[k]; c < candidate_start[k + 1]; ++c) {
+            size_t other = dynamic_index[candidate_list[c]];
+            if (other != SIZE_MAX) {
+                parent[FindRoot(parent, k)] = FindRoot(parent, other);
+            }
+        }
+    }
+
+    // Объекты k-го острова лежат в island_members с номера island_start[k]
+    // до island_start[k + 1] в порядке возрастания слотов.
+    static std::vector<size_t> island_of_root;
+    static std::vector<size_t> island_start;
+    static std::vector<size_t> island_members;
+    island_of_root.assign(dynamic.size(), SIZE_MAX);
+    island_start.clear();
+    size_t islands = 0;
+    for (size_t k = 0; k < dynamic.size(); ++k) {
+        size_t root = FindRoot(parent, k);
+        if (island_of_root[root] == SIZE_MAX) {
+            island_of_root[root] = islands++;
+        }
+    }
+    island_start.assign(islands + 1, 0);
+    for (size_t k = 0; k < dynamic.size(); ++k) {
+        island_start[island_of_root[FindRoot(parent, k)] + 1] += 1;
+    }
+    for (size_t island = 0; island < islands; ++island) {
+        island_start[island + 1] += island_start[island];
+    }
+    island_members.resize(dynamic.size());
+    static std::vector<size_t> fill;
+    fill.assign(island_start.begin(), island_start.end() - 1);
+    for (size_t k = 0; k < dynamic.size(); ++k) {
+        size_t island = island_of_root[FindRoot(parent, k)];
+        island_members[fill[island]++] = k;
+    }
+    if (islands <= JobSystem::GRAIN && !collision_islands_forced) {
+        solve_serial();
+        return;
+    }
+
+    RunChunks(jobs, islands, [&](size_t begin, size_t end) {
+        for (size_t island = begin; island < end; ++island) {
+            for (size_t m = island_start[island]; m < island_start[island + 1];
+                 ++m) {
+                solve_object(island_members[m]);
+            }
+        }
+    });
+}
 
 // Задание ApplyGravity.
 //
@@ -119,7 +571,16 @@ void FixCollisions(Scene &scene, float dt) {}
 // Возможное решение может занимать примерно 8-9 строки.
 // Ваше решение может сильно отличаться.
 //
-void ApplyGravity(Object &obj, float dt) {}
+void ApplyGravity(ObjectRef obj, float dt) {
+    if (!obj.physics.enabled || !obj.collider.of_type(ColliderType::DYNAMIC)) {
+        return;
+    }
+    const float max_fall_speed = 200.0f;
+    obj.physics.acceleration.y -= GRAVITY * dt * dt;
+    obj.physics.speed += obj.physics.acceleration;
+    obj.physics.speed.y = std::max(obj.physics.speed.y, -max_fall_speed);
+    obj.position += obj.physics.speed * dt;
+}
 
 // Задание MakeJump.
 //
@@ -136,7 +597,12 @@ void ApplyGravity(Object &obj, float dt) {}
 // Возможное решение может занимать примерно 3 строки.
 // Ваше решение может сильно отличаться.
 //
-void MakeJump(Object &obj, float dt) {}
+void MakeJump(ObjectRef obj, [[maybe_unused]] float dt) {
+    if (obj.physics.can_jump) {
+        obj.physics.speed.y = 25.0f;
+        obj.physics.can_jump = false;
+    }
+}
 
 // Задание MoveCameraTowards.
 //
@@ -155,7 +621,32 @@ void MakeJump(Object &obj, float dt) {}
 // Возможное решение может занимать примерно 5 строк.
 // Ваше решение может сильно отличаться.
 //
-void MoveCameraTowards(Context &ctx, Object &obj, float dt) {}
+void MoveCameraTowards(Context &ctx, ObjectRef obj, float dt) {
+    // Камера движется тем быстрее, чем дальше она от объекта.
+    Vector2 d = obj.position - ctx.camera_pos;
+    float distance = Vector2Length(d);
+    float step = std::min(distance, distance * 3.0f * dt);
+    if (distance > 0) {
+        ctx.camera_pos += d / distance * step;
+    }
+}
+
+// Возвращает true, если obj касается хотя бы одного объекта из view
+// (например, scene.WithEnemy()). Все такие объекты проверяются одним вызовом
+// CollideBatch.
+static bool TouchesAny(ObjectRef obj, SceneView view) {
+    static AabbBatch batch;
+    static std::vector<AabbHit> hits;
+    batch.Clear();
+    for (ObjectRef other : view) {
+        batch.Add(
+            other.position, {other.collider.width, other.collider.height}
+        );
+    }
+    Vector2 size = {obj.collider.width, obj.collider.height};
+    CollideBatch(obj.position, size, batch, 0, hits);
+    return !hits.empty();
+}
 
 // Задание CheckPlayerDeath.
 //
@@ -164,22 +655,26 @@ void MoveCameraTowards(Context &ctx, Object &obj, float dt) {}
 // После этого, функция должна вернуть true в случае, если объект player
 // прикоснулся к такому объекту obj. Иначе, функция возвращает false.
 //
+// Перебирать для этого всю сцену не нужно: scene.WithEnemy() перечисляет
+// только врагов.
+//
 // Рекомендуемые функции для выполнения задания:
 // - CheckCollision
 //
 // Возможное решение может занимать примерно 6-7 строк.
 // Ваше решение может сильно отличаться.
 //
-bool CheckPlayerDeath(Object &player, Scene &scene) {
-    return false;
+bool CheckPlayerDeath(ObjectRef player, Scene &scene) {
+    return TouchesAny(player, scene.WithEnemy());
 }
 
 // Задание CheckFinish.
 //
 // Эта функция вызывается каждый кадр игры. Для её реализации необходимо
-// проходить по всем объектам в сцене, у которых включён obj.finish.enabled.
-// После этого, функция должна вернуть true в случае, если объект player
-// прикоснулся к такому объекту obj. Иначе, функция возвращает false.
+// проходить по всем объектам в сцене, у которых включён obj.finish.enabled
+// (их перечисляет scene.WithFinish()). После этого, функция должна вернуть
+// true в случае, если объект player прикоснулся к такому объекту obj. Иначе,
+// функция возвращает false.
 //
 // Рекомендуемые функции для выполнения задания:
 // - CheckCollision
@@ -190,8 +685,8 @@ bool CheckPlayerDeath(Object &player, Scene &scene) {
 // Возможное решение может занимать примерно 6-7 строк.
 // Ваше решение может сильно отличаться.
 //
-bool CheckFinish(Object &player, Scene &scene) {
-    return false;
+bool CheckFinish(ObjectRef player, Scene &scene) {
+    return TouchesAny(player, scene.WithFinish());
 }
 
 // Задание EnemyAI.
@@ -222,8 +717,8 @@ bool CheckFinish(Object &player, Scene &scene) {
 // Возможное решение может занимать примерно 16-20 строк.
 // Ваше решение может сильно отличаться.
 //
-void EnemyAI(Object &enemy, Scene &scene, float dt) {
-    Object *player = find_player(scene);
+void EnemyAI(ObjectRef enemy, Scene &scene, float dt) {
+    ObjectPtr player = find_player(scene);
 
     if (!player) {
         return;
@@ -258,8 +753,13 @@ void EnemyAI(Object &enemy, Scene &scene, float dt) {
 //   описывать движение влево. Тогда положение игрока меняется на основе вектора
 //   move, умноженного на скорость игрока и время, прошедшее с прошлого кадра.
 //
+// Нажатия клавиш проверяются через ctx.input.KeyDown и ctx.input.KeyPressed,
+// которые в обычной игре работают как IsKeyDown и IsKeyPressed. Так игрока
+// можно проверить и без окна, подставив заранее записанные нажатия.
+//
 // Рекомендуемые функции для выполнения задания:
-// - IsKeyDown
+// - ctx.input.KeyDown
+// - ctx.input.KeyPressed
 // - MakeJump
 // - ShootBullet
 //
@@ -269,7 +769,28 @@ void EnemyAI(Object &enemy, Scene &scene, float dt) {
 // Возможное решение может занимать примерно 16-20 строк.
 // Ваше решение может сильно отличаться.
 //
-void PlayerControl(Context &ctx, Object &player, float dt) {}
+void PlayerControl(Context &ctx, ObjectRef player, float dt) {
+    if (ctx.input_blocked) {
+        return;
+    }
+    if (ctx.input.KeyDown(KEY_SPACE)) {
+        MakeJump(player, dt);
+    }
+    if (ctx.input.KeyPressed(KEY_J)) {
+        ShootBullet(ctx, player, dt);
+    }
+
+    Vector2 move = {0, 0};
+    if (ctx.input.KeyDown(KEY_A)) {
+        move.x -= 1;
+        player.player.direction = Direction::LEFT;
+    }
+    if (ctx.input.KeyDown(KEY_D)) {
+        move.x += 1;
+        player.player.direction = Direction::RIGHT;
+    }
+    player.position += move * player.player.speed * dt;
+}
 
 // Задание ShootBullet.
 //
@@ -308,7 +829,20 @@ void PlayerControl(Context &ctx, Object &player, float dt) {}
 //
 // Возможное решение может занимать примерно 8-10 строк.
 //
-void ShootBullet(Context &ctx, Object &player, float dt) {}
+void ShootBullet(Context &ctx, ObjectRef player, [[maybe_unused]] float dt) {
+    Object bullet = Object();
+    bullet.position = player.position;
+    if (!ctx.bullet_texture) {
+        ctx.bullet_texture = ctx.textures.MakeKey(
+            "Assets/bullet.png", TextureResize::SCALE, 0.3f, 0
+        );
+    }
+    bullet.render = Render(ctx, *ctx.bullet_texture);
+    bullet.collider = Collider(bullet.render, {ColliderType::EVENT});
+    float speed = player.player.direction == Direction::LEFT ? -20.0f : 20.0f;
+    bullet.bullet = Bullet(Vector2{speed, 0}, 2.0f);
+    Spawn(ctx, std::move(bullet));
+}
 
 // Задание UpdateBullet.
 //
@@ -334,7 +868,62 @@ void ShootBullet(Context &ctx, Object &player, float dt) {}
 // Возможное решение может занимать примерно 4-5 строк.
 // Ваше решение может сильно отличаться.
 //
-void UpdateBullet(Context &ctx, Object &obj, float dt) {}
+// В отличие от задания, решение ниже уничтожает пулю, как только она
+// касается стены, а не только по истечении max_lifetime. Раньше пули летели
+// сквозь стены, и проверять их путь на проскакивание было бы незачем.
+//
+void UpdateBullet(Context &ctx, ObjectRef obj, float dt) {
+    Vector2 motion = obj.bullet.speed * dt;
+    Vector2 size = {obj.collider.width, obj.collider.height};
+
+    // Пуля, которая попала в стену, исчезает. Пуля игрока, прижатого к
+    // стене, появляется уже внутри неё, и SweepCollision такое попадание
+    // не находит, поэтому сначала проверяется пересечение на месте.
+    const TileMap &tiles = *ctx.current_scene.tiles;
+    if (OverlapsTiles(tiles, obj)
+        || SweepTiles(tiles, obj.position, size, motion).exists) {
+        Destroy(ctx, obj);
+        return;
+    }
+
+    // Медленную пулю KillEnemies найдёт по пересечению в конце шага, а
+    // быструю нужно проверить на всём пути, иначе она пролетит врага
+    // насквозь. Тогда пуля останавливается внутри первого задетого врага,
+    // и KillEnemies засчитает попадание.
+    if (IsFastMotion(motion, size)) {
+        SweptCollision first = {false, 1, {0, 0}};
+        bool inside = false;
+        for (ObjectRef enemy : ctx.current_scene.WithEnemy()) {
+            // Пуля, которая уже внутри врага, остаётся на месте.
+            if (CheckCollision(obj, enemy).exists) {
+                inside = true;
+                break;
+            }
+            SweptCollision c = SweepCollision(
+                obj.position,
+                size,
+                motion,
+                enemy.position,
+                {enemy.collider.width, enemy.collider.height}
+            );
+            if (c.exists && c.time <= first.time) {
+                first = c;
+            }
+        }
+        if (inside) {
+            motion = {0, 0};
+        } else if (first.exists) {
+            Vector2 depth = Vector2Normalize(motion) * (size * 0.5f);
+            motion = motion * first.time + depth;
+        }
+    }
+
+    obj.position += motion;
+    obj.bullet.lifetime += dt;
+    if (obj.bullet.lifetime > obj.bullet.max_lifetime) {
+        Destroy(ctx, obj);
+    }
+}
 
 // Задание KillEnemies.
 //
@@ -358,7 +947,99 @@ void UpdateBullet(Context &ctx, Object &obj, float dt) {}
 //
 // Возможное решение может занимать примерно 14-20 строк.
 //
-void KillEnemies(Context &ctx) {}
+void KillEnemies(Context &ctx) {
+    Scene &scene = ctx.current_scene;
+
+    // Вместо перебора всех пар враг-пуля враги и пули собираются в один
+    // список и сортируются по левому краю. При проходе по списку хранятся
+    // только те враги и пули, правый край которых ещё не остался левее
+    // текущего объекта. Проверять пересечение нужно только с ними, поэтому
+    // время работы почти не зависит от размера уровня.
+    struct Body {
+        float left, right;
+        size_t slot;
+        bool is_bullet;
+    };
+    static std::vector<Body> bodies;
+    static std::vector<Body> active_enemies, active_bullets;
+    static std::vector<std::pair<size_t, size_t>> hits;
+    if (scene.bullet_slots.empty() || scene.enemy_slots.empty()) {
+        return;
+    }
+    bodies.clear();
+    for (bool is_bullet : {false, true}) {
+        const std::vector<size_t> &slots
+            = is_bullet ? scene.bullet_slots : scene.enemy_slots;
+        for (size_t i : slots) {
+            float half_width = scene.colliders[i].width * 0.5f;
+            float x = scene.positions[i].x;
+            bodies.push_back(
+                Body{x - half_width, x + half_width, i, is_bullet}
+            );
+        }
+    }
+    std::sort(bodies.begin(), bodies.end(), [](const Body &a, const Body &b) {
+        return a.left < b.left;
+    });
+
+    auto drop_passed = [](std::vector<Body> &active, float left) {
+        active.erase(
+            std::remove_if(
+                active.begin(),
+                active.end(),
+                [left](const Body &body) { return body.right <= left; }
+            ),
+            active.end()
+        );
+    };
+
+    active_enemies.clear();
+    active_bullets.clear();
+    hits.clear();
+    for (const Body &body : bodies) {
+        drop_passed(active_enemies, body.left);
+        drop_passed(active_bullets, body.left);
+        const std::vector<Body> &others
+            = body.is_bullet ? active_enemies : active_bullets;
+        for (const Body &other : others) {
+            size_t enemy = body.is_bullet ? other.slot : body.slot;
+            size_t bullet = body.is_bullet ? body.slot : other.slot;
+            if (CheckCollision(scene[enemy], scene[bullet]).exists) {
+                hits.push_back({enemy, bullet});
+            }
+        }
+        (body.is_bullet ? active_bullets : active_enemies).push_back(body);
+    }
+
+    // Каждый враг погибает от первой по порядку в сцене пули, которая в него
+    // попала и ещё не была потрачена на другого врага. Так одна пуля убивает
+    // не больше одного врага, а результат не зависит от порядка сортировки.
+    // Потраченные пули отмечаются в bullet_used по слоту. После прохода
+    // отметки снимаются по списку used_bullets, так что очистка стоит
+    // столько же, сколько попаданий, а не O(n).
+    std::sort(hits.begin(), hits.end());
+    static std::vector<uint8_t> bullet_used;
+    static std::vector<size_t> used_bullets;
+    if (bullet_used.size() < scene.size()) {
+        bullet_used.resize(scene.size(), 0);
+    }
+    used_bullets.clear();
+    size_t last_enemy = scene.size();
+    for (auto [enemy, bullet] : hits) {
+        if (enemy == last_enemy || bullet_used[bullet]) {
+            continue;
+        }
+        last_enemy = enemy;
+        bullet_used[bullet] = 1;
+        used_bullets.push_back(bullet);
+        Destroy(ctx, scene[enemy]);
+        Destroy(ctx, scene[bullet]);
+        ApplyOnDeath(ctx, scene[enemy]);
+    }
+    for (size_t bullet : used_bullets) {
+        bullet_used[bullet] = 0;
+    }
+}
 
 // Задание ApplyOnDeath.
 //
@@ -370,12 +1051,13 @@ void KillEnemies(Context &ctx) {}
 // Объект может быть игроком, тогда у него активно obj.player.enabled, или
 // врагом, тогда у него активно obj.enemy.enabled.
 //
-// Для реализации необходимо сначала загрузить звук из файла, используя функцию
-// LoadSound, после чего воспроизвести его.
+// Все звуки заранее загружены в ctx.sounds при запуске игры, а их номера
+// лежат в ctx.death_sound и ctx.enemy_death_sound. Загружать звук через
+// LoadSound здесь не нужно: это чтение и декодирование файла на каждую
+// смерть. Достаточно запустить готовый звук по номеру.
 //
 // Рекомендуемые функции для выполнения задания:
-// - LoadSound
-// - PlaySound
+// - ctx.sounds.Play
 //
 // При реализации данного задания у вас есть возможность добавить свои
 // звуки смерти игрока и противников Assets/Sounds/enemy_death.mp3 и
@@ -383,7 +1065,13 @@ void KillEnemies(Context &ctx) {}
 //
 // Возможное решение может занимать примерно 6-8 строк.
 //
-void ApplyOnDeath(Context &ctx, Object &obj) {}
+void ApplyOnDeath(Context &ctx, ObjectRef obj) {
+    if (obj.player.enabled) {
+        ctx.sounds.Play(ctx.death_sound);
+    } else if (obj.enemy.enabled) {
+        ctx.sounds.Play(ctx.enemy_death_sound);
+    }
+}
 
 // Задание ApplyOnSpawn.
 //
@@ -393,19 +1081,23 @@ void ApplyOnDeath(Context &ctx, Object &obj) {}
 // воспроизводится звук выстрела, в противном случае никакой звук не
 // воспроизводится.
 //
-// Для реализации необходимо сначала загрузить звук из файла, используя функцию
-// LoadSound, после чего воспроизвести его.
+// Звук выстрела заранее загружен в ctx.sounds, его номер - ctx.shot_sound.
+// Выстрелы бывают часто, поэтому загружать звук через LoadSound на каждый из
+// них слишком дорого.
 //
 // Рекомендуемые функции для выполнения задания:
-// - LoadSound
-// - PlaySound
+// - ctx.sounds.Play
 //
 // При реализации данного задания у вас есть возможность добавить свои
 // звуки выстрелов Assets/Sounds/shot.mp3.
 //
 // Возможное решение может занимать примерно 3 строки.
 //
-void ApplyOnSpawn(Context &ctx, Object &obj) {}
+void ApplyOnSpawn(Context &ctx, ObjectRef obj) {
+    if (obj.bullet.enabled) {
+        ctx.sounds.Play(ctx.shot_sound);
+    }
+}
 
 // Задание DrawDeathScreen.
 //
@@ -421,7 +1113,7 @@ void ApplyOnSpawn(Context &ctx, Object &obj) {}
 //
 // Возможное решение может занимать примерно N строк.
 //
-void DrawDeathScreen(Context &ctx) {}
+void DrawDeathScreen([[maybe_unused]] Context &ctx) {}
 
 // Задание DrawGameOverScreen.
 //
@@ -437,7 +1129,7 @@ void DrawDeathScreen(Context &ctx) {}
 //
 // Возможное решение может занимать примерно N строк.
 //
-void DrawGameOverScreen(Context &ctx) {}
+void DrawGameOverScreen([[maybe_unused]] Context &ctx) {}
 
 // Задание DrawFinishScreen.
 //
@@ -453,7 +1145,7 @@ void DrawGameOverScreen(Context &ctx) {}
 //
 // Возможное решение может занимать примерно N строк.
 //
-void DrawFinishScreen(Context &ctx) {}
+void DrawFinishScreen([[maybe_unused]] Context &ctx) {}
 
 // Задание DrawMainScreen.
 //
@@ -465,37 +1157,31 @@ void DrawFinishScreen(Context &ctx) {}
 //
 // Возможное решение может занимать примерно N строк.
 //
-void DrawMainScreen(Context &ctx) {}
+void DrawMainScreen([[maybe_unused]] Context &ctx) {}
 
 bool IsMouseOnButton(Rectangle btn) {
     Vector2 mousePoint = GetMousePosition();
     return CheckCollisionPointRec(mousePoint, btn);
 }
 
-void ChangeButtonState(
-    Context &ctx,
-    Rectangle btnCollider,
-    size_t btn_id,
-    std::string path1,
-    std::string path2
-) {
+// Состояния кнопок меню, номера состояний в SpriteState.
+enum ButtonState { BUTTON_NORMAL, BUTTON_HOVER, BUTTON_PRESSED };
+
+// Переключает картинку кнопки с идентификатором btn_id в зависимости от того,
+// находится ли над ней курсор и нажата ли кнопка мыши. Картинки всех
+// состояний загружены заранее в ConstructMenuScene, поэтому здесь только
+// меняется номер состояния.
+void ChangeButtonState(Context &ctx, Rectangle btnCollider, size_t btn_id) {
+    ObjectPtr button = ctx.current_scene.find(btn_id);
+    if (!button || !button->sprite.enabled) {
+        return;
+    }
+    int state = BUTTON_NORMAL;
     if (IsMouseOnButton(btnCollider)) {
-        for (auto &obj : ctx.current_scene) {
-            if (obj.id == btn_id) {
-                obj.render = Render(
-                    ctx, path2, Vector2(btnCollider.width, btnCollider.height)
-                );
-            }
-        }
-    } else {
-        for (auto &obj : ctx.current_scene) {
-            if (obj.id == btn_id) {
-                obj.render = Render(
-                    ctx, path1, Vector2(btnCollider.width, btnCollider.height)
-                );
-            }
-        }
+        state = IsMouseButtonDown(MOUSE_BUTTON_LEFT) ? BUTTON_PRESSED
+                                                     : BUTTON_HOVER;
     }
+    button->sprite.Set(state, button->render);
 }
 
 // Задание ConstructMenuScene.
@@ -529,6 +1215,10 @@ void ConstructMenuScene(Context &ctx, Scene &game_scene) {
     Object startBtn = Object();
     startBtn.id = 1;
     startBtn.render = Render(ctx, "Assets/start_button1.png", Vector2(200, 50));
+    Render hover = Render(ctx, "Assets/start_button2.png", Vector2(200, 50));
+    // Отдельной картинки для нажатой кнопки нет, поэтому нажатая кнопка
+    // выглядит так же, как кнопка под курсором.
+    startBtn.sprite = SpriteState({startBtn.render, hover, hover});
     startBtn.position = Vector2(-5, 0);
     game_scene.push_back(startBtn);
 }
@@ -540,9 +1230,9 @@ void ConstructMenuScene(Context &ctx, Scene &game_scene) {
 // В самой панели должны отображаться следующие параметры:
 // - Количество жизней игрока. Для этого следует использовать текстуру
 //   сердечка, которая сохранена в контексте игры.
-//   Для того, чтобы получить саму текстуру сердца можно написать
-//     Texture heart_texture = ctx.textures_storage[ctx.heart->hash];
-//   После этого текстуру можно использовать функцию DrawTexture.
+//   Для того, чтобы нарисовать сердце, можно написать
+//     DrawTextureById(ctx, ctx.heart->texture, pos);
+//   где pos - положение левого верхнего угла сердца на экране.
 // - Текущий счёт игрока. Он хранится в поле ctx.score.
 // - Время с начала игры. Оно хранится в поле ctx.time в миллисекундах (!!!)
 //   Желательно выводить время отдельно в минутах и секундах.
@@ -559,4 +1249,4 @@ void ConstructMenuScene(Context &ctx, Scene &game_scene) {
 //
 // Возможное решение может занимать примерно N строк.
 //
-void DrawStatus(Context &ctx) {}
+void DrawStatus([[maybe_unused]] Context &ctx) {}
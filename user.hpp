@@ -2,26 +2,36 @@
 
 #include "internal.hpp"
 
-Collision CheckCollision(Object &obj1, Object &obj2);
-void SolveCollision(Object &obj, Collision c, float dt);
-void FixCollisions(Scene &scene, float dt);
-void ApplyGravity(Object &obj, float dt);
-void MakeJump(Object &obj, float dt);
-void MoveCameraTowards(Context &ctx, Object &obj, float dt);
-bool CheckPlayerDeath(Object &player, Scene &scene);
-bool CheckFinish(Object &player, Scene &scene);
-void EnemyAI(Object &crab, Scene &scene, float dt);
-void PlayerControl(Context &, Object &player, float dt);
-void ShootBullet(Context &, Object &player, float dt);
-void UpdateBullet(Context &, Object &obj, float dt);
+Collision CheckCollision(ObjectRef obj1, ObjectRef obj2);
+Collision CheckCollision(ObjectRef obj, const TileRect &rect);
+SweptCollision SweepCollision(
+    Vector2 position,
+    Vector2 size,
+    Vector2 motion,
+    Vector2 other_position,
+    Vector2 other_size
+);
+bool IsFastMotion(Vector2 motion, Vector2 size);
+void SolveCollision(ObjectRef obj, Collision c, float dt);
+void SolveCollision(ObjectRef obj, SweptCollision c, Vector2 start);
+void FixCollisions(Scene &scene, float dt, JobSystem *jobs = nullptr);
+void ApplyGravity(ObjectRef obj, float dt);
+void MakeJump(ObjectRef obj, float dt);
+void MoveCameraTowards(Context &ctx, ObjectRef obj, float dt);
+bool CheckPlayerDeath(ObjectRef player, Scene &scene);
+bool CheckFinish(ObjectRef player, Scene &scene);
+void EnemyAI(ObjectRef crab, Scene &scene, float dt);
+void PlayerControl(Context &, ObjectRef player, float dt);
+void ShootBullet(Context &, ObjectRef player, float dt);
+void UpdateBullet(Context &, ObjectRef obj, float dt);
 void KillEnemies(Context &);
 void DrawDeathScreen(Context &);
 void DrawFinishScreen(Context &);
 void DrawMainScreen(Context &);
 void DrawGameOverScreen(Context &);
-void ApplyOnDeath(Context &, Object &);
-void ApplyOnSpawn(Context &, Object &);
+void ApplyOnDeath(Context &, ObjectRef);
+void ApplyOnSpawn(Context &, ObjectRef);
 void DrawStatus(Context &);
 bool IsMouseOnButton(Rectangle btn);
-void ChangeButtonState(Context &ctx, Rectangle btnCollider, size_t btn_id, std::string path1, std::string path2);
+void ChangeButtonState(Context &ctx, Rectangle btnCollider, size_t btn_id);
 void ConstructMenuScene(Context &ctx, Scene &game_scene);